@@ -56,25 +56,32 @@
 #ifndef MERSENNE_TWISTER
 #include <stdio.h>
 #endif
+#include "mt19937_64.h"
 
-#define NN 312
+#define NN MT19937_64_NN
 #define MM 156
 #define MATRIX_A 0xB5026F5AA96619E9ULL
 #define UM 0xFFFFFFFF80000000ULL /* Most significant 33 bits */
 #define LM 0x7FFFFFFFULL /* Least significant 31 bits */
 
 
-/* The array for the state vector */
-static unsigned long long mt[NN]; 
+/* The state vector of the non reentrant functions */
 /* mti==NN+1 means mt[NN] is not initialized */
-static int mti=NN+1; 
+static mt19937_64_t state = { .mti = NN+1 };
+
+/* initializes a state vector with a seed */
+void init_genrand64_r(mt19937_64_t *s, unsigned long long seed)
+{
+    s->mt[0] = seed;
+    for (s->mti=1; s->mti<NN; s->mti++) 
+        s->mt[s->mti] =  (6364136223846793005ULL *
+            (s->mt[s->mti-1] ^ (s->mt[s->mti-1] >> 62)) + s->mti);
+}
 
 /* initializes mt[NN] with a seed */
 void init_genrand64(unsigned long long seed)
 {
-    mt[0] = seed;
-    for (mti=1; mti<NN; mti++) 
-        mt[mti] =  (6364136223846793005ULL * (mt[mti-1] ^ (mt[mti-1] >> 62)) + mti);
+    init_genrand64_r(&state, seed);
 }
 
 /* initialize by an array with array-length */
@@ -88,51 +95,51 @@ unsigned long long init_key[], key_length;
     i=1; j=0;
     k = (NN>key_length ? NN : key_length);
     for (; k; k--) {
-        mt[i] = (mt[i] ^ ((mt[i-1] ^ (mt[i-1] >> 62)) * 3935559000370003845ULL))
+        state.mt[i] = (state.mt[i] ^ ((state.mt[i-1] ^ (state.mt[i-1] >> 62)) * 3935559000370003845ULL))
           + init_key[j] + j; /* non linear */
         i++; j++;
-        if (i>=NN) { mt[0] = mt[NN-1]; i=1; }
+        if (i>=NN) { state.mt[0] = state.mt[NN-1]; i=1; }
         if (j>=key_length) j=0;
     }
     for (k=NN-1; k; k--) {
-        mt[i] = (mt[i] ^ ((mt[i-1] ^ (mt[i-1] >> 62)) * 2862933555777941757ULL))
+        state.mt[i] = (state.mt[i] ^ ((state.mt[i-1] ^ (state.mt[i-1] >> 62)) * 2862933555777941757ULL))
           - i; /* non linear */
         i++;
-        if (i>=NN) { mt[0] = mt[NN-1]; i=1; }
+        if (i>=NN) { state.mt[0] = state.mt[NN-1]; i=1; }
     }
 
-    mt[0] = 1ULL << 63; /* MSB is 1; assuring non-zero initial array */ 
+    state.mt[0] = 1ULL << 63; /* MSB is 1; assuring non-zero initial array */ 
 }
 
-/* generates a random number on [0, 2^64-1]-interval */
-unsigned long long genrand64_int64(void)
+/* generates a random number on [0, 2^64-1]-interval from a state vector */
+unsigned long long genrand64_int64_r(mt19937_64_t *s)
 {
     int i;
     unsigned long long x;
-    static unsigned long long mag01[2]={0ULL, MATRIX_A};
+    static const unsigned long long mag01[2]={0ULL, MATRIX_A};
 
-    if (mti >= NN) { /* generate NN words at one time */
+    if (s->mti >= NN) { /* generate NN words at one time */
 
-        /* if init_genrand64() has not been called, */
+        /* if init_genrand64_r() has not been called, */
         /* a default initial seed is used     */
-        if (mti == NN+1) 
-            init_genrand64(5489ULL); 
+        if (s->mti == NN+1) 
+            init_genrand64_r(s, 5489ULL); 
 
         for (i=0;i<NN-MM;i++) {
-            x = (mt[i]&UM)|(mt[i+1]&LM);
-            mt[i] = mt[i+MM] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
+            x = (s->mt[i]&UM)|(s->mt[i+1]&LM);
+            s->mt[i] = s->mt[i+MM] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
         }
         for (;i<NN-1;i++) {
-            x = (mt[i]&UM)|(mt[i+1]&LM);
-            mt[i] = mt[i+(MM-NN)] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
+            x = (s->mt[i]&UM)|(s->mt[i+1]&LM);
+            s->mt[i] = s->mt[i+(MM-NN)] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
         }
-        x = (mt[NN-1]&UM)|(mt[0]&LM);
-        mt[NN-1] = mt[MM-1] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
+        x = (s->mt[NN-1]&UM)|(s->mt[0]&LM);
+        s->mt[NN-1] = s->mt[MM-1] ^ (x>>1) ^ mag01[(int)(x&1ULL)];
 
-        mti = 0;
+        s->mti = 0;
     }
   
-    x = mt[mti++];
+    x = s->mt[s->mti++];
 
     x ^= (x >> 29) & 0x5555555555555555ULL;
     x ^= (x << 17) & 0x71D67FFFEDA60000ULL;
@@ -142,6 +149,12 @@ unsigned long long genrand64_int64(void)
     return x;
 }
 
+/* generates a random number on [0, 2^64-1]-interval */
+unsigned long long genrand64_int64(void)
+{
+    return genrand64_int64_r(&state);
+}
+
 /* generates a random number on [0, 2^63-1]-interval */
 long long genrand64_int63(void)
 {
@@ -1,6 +1,21 @@
 #ifndef _MT19937_64_
 #define _MT19937_64_
 
+#define MT19937_64_NN 312
+
+/* the state vector of a generator, for use with the reentrant *_r() functions.
+ * the remaining functions share a single static state vector */
+typedef struct {
+    unsigned long long mt[MT19937_64_NN];
+    int mti;
+} mt19937_64_t;
+
+/* initializes a state vector with a seed */
+void init_genrand64_r(mt19937_64_t *s, unsigned long long seed);
+
+/* generates a random number on [0, 2^64-1]-interval from a state vector */
+unsigned long long genrand64_int64_r(mt19937_64_t *s);
+
 /* initializes mt[NN] with a seed */
 void init_genrand64(unsigned long long seed);
 
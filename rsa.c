@@ -720,8 +720,10 @@ int rsa_key_enclev_set(rsa_key_t *key, int new_level)
 	ret = rsa_read_u1024_full(key->file, &key->exp) ||
 		rsa_read_u1024_full(key->file, &key->n) || 
 		rsa_read_u1024_full(key->file, &montgomery_factor) ? -1 : 0;
-	if (!ret)
+	if (!ret) {
 		number_montgomery_factor_set(&key->n, &montgomery_factor);
+		number_exponent_schedule_set(&key->exp);
+	}
 	return ret;
 }
 
@@ -1048,23 +1050,27 @@ static void rsa_zero_one(u1024_t *res, u1024_t *data)
 	res->top = -1;
 }
 
-void rsa_encode(u1024_t *res, u1024_t *data, u1024_t *exp, u1024_t *n)
+/* r = data % n, q = data / n. returns non zero if r is 0 or 1, which are not
+ * encoded by exponentiation */
+static int rsa_encode_reduce(u1024_t *r, u64 *q, u1024_t *data, u1024_t *n)
 {
-	u64 q;
-	u1024_t r;
-
 	if (number_is_greater_or_equal(data, n)) {
-		u1024_t num_q;
-
-		number_dev(&num_q, &r, data, n);
-		q = *(u64*)&num_q;
+		*q = number_dev_small(r, data, n);
 	}
 	else {
-		number_assign(r, *data);
-		q = (u64)0;
+		number_assign(*r, *data);
+		*q = (u64)0;
 	}
 
-	if (number_is_equal(&r, &NUM_0) || number_is_equal(&r, &NUM_1)) {
+	return number_is_equal(r, &NUM_0) || number_is_equal(r, &NUM_1);
+}
+
+void rsa_encode(u1024_t *res, u1024_t *data, u1024_t *exp, u1024_t *n)
+{
+	u64 q;
+	u1024_t r;
+
+	if (rsa_encode_reduce(&r, &q, data, n)) {
 		rsa_zero_one(res, data);
 		return;
 	}
@@ -1073,6 +1079,34 @@ void rsa_encode(u1024_t *res, u1024_t *data, u1024_t *exp, u1024_t *n)
 	res->arr[block_sz_u1024] = q;
 }
 
+/* rsa_encode() of count blocks. res may be data.
+ * the blocks to be exponentiated are gathered, RSA_BATCH_SZ at a time, and
+ * exponentiated together */
+void rsa_encode_batch(u1024_t *res, u1024_t *data, int count, u1024_t *exp,
+	u1024_t *n)
+{
+	u1024_t r[RSA_BATCH_SZ];
+	u64 q[RSA_BATCH_SZ];
+	int idx[RSA_BATCH_SZ], i, exps, batch;
+
+	for ( ; count > 0; count -= batch, res += batch, data += batch) {
+		batch = MIN(count, RSA_BATCH_SZ);
+		for (i = exps = 0; i < batch; i++) {
+			if (rsa_encode_reduce(&r[exps], &q[i], &data[i], n))
+				rsa_zero_one(&res[i], &data[i]);
+			else
+				idx[exps++] = i;
+		}
+
+		number_modular_exponentiation_montgomery_batch(r, r, exps, exp,
+			n);
+		for (i = 0; i < exps; i++) {
+			number_assign(res[idx[i]], r[i]);
+			res[idx[i]].arr[block_sz_u1024] = q[idx[i]];
+		}
+	}
+}
+
 void rsa_decode(u1024_t *res, u1024_t *data, u1024_t *exp, u1024_t *n)
 {
 	u64 q;
@@ -1088,12 +1122,43 @@ void rsa_decode(u1024_t *res, u1024_t *data, u1024_t *exp, u1024_t *n)
 	r.arr[block_sz_u1024] = 0;
 	number_modular_exponentiation_montgomery(res, &r, exp, n);
 
-	if (q) {
-		u1024_t num_q;
+	if (q)
+		number_mul_small_add(res, n, q);
+}
 
-		number_small_dec2num(&num_q, q);
-		number_mul(&num_q, &num_q, n);
-		number_add(res, res, &num_q);
+/* rsa_decode() of count blocks. res may be data.
+ * the blocks to be exponentiated are gathered, RSA_BATCH_SZ at a time, and
+ * exponentiated together */
+void rsa_decode_batch(u1024_t *res, u1024_t *data, int count, u1024_t *exp,
+	u1024_t *n)
+{
+	u1024_t r[RSA_BATCH_SZ];
+	u64 q[RSA_BATCH_SZ];
+	int idx[RSA_BATCH_SZ], i, exps, batch;
+
+	for ( ; count > 0; count -= batch, res += batch, data += batch) {
+		batch = MIN(count, RSA_BATCH_SZ);
+		for (i = exps = 0; i < batch; i++) {
+			if (data[i].top == -1) {
+				rsa_zero_one(&res[i], &data[i]);
+				continue;
+			}
+
+			q[i] = data[i].arr[block_sz_u1024];
+			number_assign(r[exps], data[i]);
+			r[exps].arr[block_sz_u1024] = 0;
+			idx[exps++] = i;
+		}
+
+		number_modular_exponentiation_montgomery_batch(r, r, exps, exp,
+			n);
+		for (i = 0; i < exps; i++) {
+			u1024_t *res_i = &res[idx[i]];
+
+			number_assign(*res_i, r[i]);
+			if (q[idx[i]])
+				number_mul_small_add(res_i, n, q[idx[i]]);
+		}
 	}
 }
 
@@ -19,6 +19,7 @@
 
 #define BUF_LEN_UNIT_QUICK 1024
 #define BLOCKS_PER_DATA_BUF 128
+#define RSA_BATCH_SZ 16
 
 #define MIN(x, y) ((x) < (y) ? (x) : (y))
 
@@ -111,5 +112,9 @@ int rsa_key_enclev_set(rsa_key_t *key, int new_level);
 int rsa_encryption_level_set(char *optarg);
 void rsa_encode(u1024_t *res, u1024_t *data, u1024_t *exp, u1024_t *n);
 void rsa_decode(u1024_t *res, u1024_t *data, u1024_t *exp, u1024_t *n);
+void rsa_encode_batch(u1024_t *res, u1024_t *data, int count, u1024_t *exp,
+	u1024_t *n);
+void rsa_decode_batch(u1024_t *res, u1024_t *data, int count, u1024_t *exp,
+	u1024_t *n);
 #endif
 
@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include "rsa.h"
@@ -116,29 +117,31 @@ static void rsa_infimum(u1024_t *inf)
 	inf->top = block_sz_u1024 - 1;
 }
 
-static void rsa_key_generator(u1024_t *n, u1024_t *e, u1024_t *d)
+/* the primes p1 and p2 are those found by rsa_primes_find(). they are searched
+ * again, at the global level, if their product is too small or if they are
+ * equal */
+static void rsa_key_generator(u1024_t *n, u1024_t *e, u1024_t *d,
+	u1024_t *p1, u1024_t *p2)
 {
-	u1024_t p1, p2, p1_sub1, p2_sub1, phi, inf, tmp;
-	int is_first = 1;
+	u1024_t p1_sub1, p2_sub1, phi, inf, tmp;
 
 	rsa_infimum(&inf);
-	do {
-		if (is_first)
-			is_first = 0;
-		else
-			rsa_error_message(RSA_ERR_KEYGEN);
+	rsa_printf(1, 1, "calculating product: n=p1*p2...");
+	number_mul(n, p1, p2);
+	while (!number_is_greater_or_equal(n, &inf) ||
+		number_is_equal(p1, p2)) {
+		rsa_error_message(RSA_ERR_KEYGEN);
 
 		rsa_printf(1, 1, "finding first large prime: p1...");
-		number_find_prime(&p1);
+		number_find_prime_parallel(p1, 0);
 		rsa_printf(1, 1, "finding second large prime: p2...");
-		number_find_prime(&p2);
+		number_find_prime_parallel(p2, 0);
 		rsa_printf(1, 1, "calculating product: n=p1*p2...");
-		number_mul(n, &p1, &p2);
+		number_mul(n, p1, p2);
 	}
-	while (!number_is_greater_or_equal(n, &inf));
 
-	number_assign(p1_sub1, p1);
-	number_assign(p2_sub1, p2);
+	number_assign(p1_sub1, *p1);
+	number_assign(p2_sub1, *p2);
 	number_sub1(&p1_sub1);
 	number_sub1(&p2_sub1);
 	rsa_printf(1, 1, "calculating Euler phi function for n: "
@@ -161,11 +164,65 @@ static void rsa_key_generator(u1024_t *n, u1024_t *e, u1024_t *d)
 	number_assign(*d, tmp);
 }
 
+/* a prime search of key generation, at a level, by a context of its own and
+ * threads workers */
+typedef struct {
+	number_ctx_t ctx;
+	u1024_t prime;
+	int threads;
+	pthread_t thread;
+	int is_thread;
+} rsa_prime_job_t;
+
+static void *rsa_prime_job(void *arg)
+{
+	rsa_prime_job_t *job = (rsa_prime_job_t *)arg;
+
+	number_find_prime_parallel_r(&job->ctx, &job->prime, job->threads);
+	return NULL;
+}
+
+/* finds the primes p1 and p2 of every level at once, jobs[2*i] and
+ * jobs[2*i + 1] being those of encryption_levels[i], a thread each. the online
+ * processors are dealt out to the searches, so that those left over by the
+ * jobs are put to work by number_find_prime_parallel_r(). their contexts are
+ * seeded in turn by the global random number generator, whatever the global
+ * level. a search whose thread cannot be created is run by the calling thread
+ */
+static int rsa_primes_find(rsa_prime_job_t *jobs, int count)
+{
+	int i, processors = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+	for (i = 0; i < count; i++) {
+		if (number_ctx_child_init(&jobs[i].ctx,
+			encryption_levels[i / 2])) {
+			return -1;
+		}
+		/* a job of a single thread searches by number_find_prime_r() */
+		jobs[i].threads = (processors + count - 1 - i) / count;
+		if (jobs[i].threads < 1)
+			jobs[i].threads = 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		jobs[i].is_thread = !pthread_create(&jobs[i].thread, NULL,
+			rsa_prime_job, &jobs[i]);
+	}
+	for (i = 0; i < count; i++) {
+		if (jobs[i].is_thread)
+			pthread_join(jobs[i].thread, NULL);
+		else
+			rsa_prime_job(&jobs[i]);
+	}
+	return 0;
+}
+
 int rsa_keygen(void)
 {
 	int ret, *level, is_first = 1;
 	char private_name[MAX_FILE_NAME_LEN], public_name[MAX_FILE_NAME_LEN];
 	FILE *private_key, *public_key;
+	rsa_prime_job_t *jobs, *job;
 
 	if (key_files_generate(private_name, &private_key, public_name,
 		&public_key, MAX_FILE_NAME_LEN)) {
@@ -174,13 +231,26 @@ int rsa_keygen(void)
 
 	rsa_printf(0, 0, "generating key: %s (this will take a few minutes)",
 		rsa_highlight_str(key_data + 1));
-	for (level = encryption_levels; *level; level++) {
+	for (level = encryption_levels; *level; level++);
+	if (!(jobs = calloc(2 * (level - encryption_levels),
+		sizeof(rsa_prime_job_t)))) {
+		ret = -1;
+		goto Exit;
+	}
+	rsa_printf(1, 1, "finding large primes p1 and p2 of all levels...");
+	if (rsa_primes_find(jobs, 2 * (level - encryption_levels))) {
+		ret = -1;
+		goto Exit;
+	}
+
+	for (level = encryption_levels, job = jobs; *level; level++,
+		job += 2) {
 		u1024_t n, e, d;
 
 		rsa_printf(0, 0, "generating private and public keys: %d bits",
 			*level);
 		number_enclevl_set(*level);
-		rsa_key_generator(&n, &e, &d);
+		rsa_key_generator(&n, &e, &d, &job[0].prime, &job[1].prime);
 
 		rsa_printf(1, 1, "writing %d bit keys...", *level);
 		if (is_first) {
@@ -202,6 +272,7 @@ int rsa_keygen(void)
 	ret = 0;
 
 Exit:
+	free(jobs);
 	fclose(private_key);
 	fclose(public_key);
 
@@ -394,13 +465,11 @@ static int rsa_decrypt_quick(rsa_key_t *key, FILE *ciphertext, FILE *plaintext)
 
 static int rsa_decrypt_full(rsa_key_t *key, FILE *ciphertext, FILE *plaintext)
 {
-	int len, ct_buf_len, pt_blk_sz, ct_blk_sz;
-	u1024_t num_iv, tmp;
+	int len, pt_blk_sz;
+	u1024_t num_iv;
 
-	/* determine plaintext block size and ciphertext buffer length */
+	/* determine plaintext block size */
 	pt_blk_sz = rsa_encryption_level/sizeof(u64);
-	ct_blk_sz = number_size(rsa_encryption_level);
-	ct_buf_len = BLOCKS_PER_DATA_BUF * ct_blk_sz;
 	len = 0;
 
 	/* cipher mode initialization */
@@ -416,32 +485,38 @@ static int rsa_decrypt_full(rsa_key_t *key, FILE *ciphertext, FILE *plaintext)
 
 	rsa_timeline_init(file_size, block_sz_u1024*sizeof(u64));
 	do {
-		u1024_t ct_buf[ct_buf_len];
-		int i;
-
-		for (i = 0; i < ct_buf_len && len < file_size; i++) {
-			if (rsa_read_u1024_full(ciphertext, &ct_buf[i]))
+		u1024_t ct_buf[BLOCKS_PER_DATA_BUF];
+		u1024_t iv_buf[BLOCKS_PER_DATA_BUF];
+		int i, blocks;
+
+		/* both ecb and cbc blocks are decrypted independently, a buffer
+		 * of them at a time, in a batch */
+		for (blocks = 0; blocks < BLOCKS_PER_DATA_BUF &&
+			len + blocks * pt_blk_sz < file_size; blocks++) {
+			if (rsa_read_u1024_full(ciphertext, &ct_buf[blocks]))
 				break;
 
 			/* pre decrypting cipher mode handling */
 			switch (cipher_mode)
 			{
 			case CIPHER_MODE_CBC:
-				number_assign(tmp, ct_buf[i]);
+				number_assign(iv_buf[blocks], ct_buf[blocks]);
 				break;
 			case CIPHER_MODE_ECB:
 			default:
 				break;
 			}
+		}
 
-			rsa_decode(&ct_buf[i], &ct_buf[i], &key->exp, &key->n);
+		rsa_decode_batch(ct_buf, ct_buf, blocks, &key->exp, &key->n);
 
+		for (i = 0; i < blocks; i++) {
 			/* post decrypting cipher mode handling */
 			switch (cipher_mode)
 			{
 			case CIPHER_MODE_CBC:
 				number_xor(&ct_buf[i], &ct_buf[i], &num_iv);
-				number_assign(num_iv, tmp);
+				number_assign(num_iv, iv_buf[i]);
 				num_iv.arr[block_sz_u1024] = 0;
 				number_top_set(&num_iv);
 				break;
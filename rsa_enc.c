@@ -242,30 +242,22 @@ int rsa_encrypt_full(void)
 	do {
 		char pt_buf[pt_buf_len];
 		u1024_t ct_buf[ct_buf_len];
-		int i;
+		int i, blocks;
 
 		len = fread(pt_buf, sizeof(char), pt_buf_len, plaintext);
-		for (i = 0; len && i < (len-1)/pt_blk_sz + 1; i++) {
+		blocks = len ? (len-1)/pt_blk_sz + 1 : 0;
+		for (i = 0; i < blocks; i++) {
 			number_data2num(&ct_buf[i], &pt_buf[i*pt_blk_sz],
 				pt_blk_sz);
 
-			/* pre encryption cipher mode handling */
+			/* cbc blocks are chained to their predecessors, ecb
+			 * blocks are independent and encrypted in a batch */
 			switch (cipher_mode)
 			{
 			case CIPHER_MODE_CBC:
 				number_xor(&ct_buf[i], &ct_buf[i], &num_iv);
-				break;
-			case CIPHER_MODE_ECB:
-			default:
-				break;
-			}
-
-			rsa_encode(&ct_buf[i], &ct_buf[i], &key->exp, &key->n);
-
-			/* post encryption cipher mode handling */
-			switch (cipher_mode)
-			{
-			case CIPHER_MODE_CBC:
+				rsa_encode(&ct_buf[i], &ct_buf[i], &key->exp,
+					&key->n);
 				number_assign(num_iv, ct_buf[i]);
 				num_iv.arr[block_sz_u1024] = 0;
 				number_top_set(&num_iv);
@@ -274,7 +266,14 @@ int rsa_encrypt_full(void)
 			default:
 				break;
 			}
+		}
+
+		if (cipher_mode != CIPHER_MODE_CBC) {
+			rsa_encode_batch(ct_buf, ct_buf, blocks, &key->exp,
+				&key->n);
+		}
 
+		for (i = 0; i < blocks; i++) {
 			rsa_write_u1024_full(ciphertext, &ct_buf[i]);
 			rsa_timeline_update();
 		}
@@ -1,43 +1,32 @@
 #include "rsa_util.h"
 #include "rsa_num.h"
+#include "rsa_primes.h"
 #include <stdlib.h>
 #include <sys/time.h>
 #include <time.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #ifdef MERSENNE_TWISTER
 #include "mt19937_64.h"
 #endif
+#if defined(ULLONG) && defined(__x86_64__)
+#include <immintrin.h>
+#endif
 
 #define IS_DIGIT(n) ((n)>='0' && (n)<='9')
 #define CHAR_2_INT(c) ((int)((c) - '0'))
 #define COPRIME_PRIME(X) ((X).prime)
 #define COPRIME_DIVISOR(X) ((X).divisor)
 #define ASCII_LEN_2_BIN_LEN(STR) (strlen(STR)<<3)
-#define NUMBER_GENERATE_COPRIME_ARRAY_SZ 13
-
-#define number_gcd_is_1(u, v) \
-	( \
-	  /* algorithm \
-	   * --------- \
-	   * g = 0 \
-	   * while u is even and v is even \
-	   *   u = u/2 (right shift) \
-	   *   v = v/2 \
-	   *   g = g + 1 \
-	   * now u or v (or both) are odd \
-	   * while u > 0 \
-	   *   if u is even, u = u/2 \
-	   *   else if v is even, v = v/2 \
-	   *   else if u >= v \
-	   *     u = (u-v)/2 \
-	   *   else \
-	   *     v = (v-u)/2 \
-	   * return v/2^k \
-	   * Since radix is of the form 2^k, and n is odd, their GCD is 1 */ \
-	  1 \
-	)
+/* trailing zero bits and most significant set bit index of a non zero u64 */
+#define U64_CTZ(X) __builtin_ctzll((unsigned long long)(X))
+/* the limb kernels are inlined into their fixed size instances, where their
+ * loops can be unrolled, whatever INLINE is */
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define U64_MSB_IDX(X) ((int)(sizeof(unsigned long long) << 3) - 1 - \
+	__builtin_clzll((unsigned long long)(X)))
 
 u1024_t NUM_0 = { .arr[0] = 0 };
 u1024_t NUM_1 = { .arr[0] = 1 };
@@ -57,10 +46,17 @@ typedef struct code2list_t {
 	int disabled;
 } code2list_t;
 
-STATIC u1024_t num_montgomery_n, num_res_nresidue;
-static u1024_t num_montgomery_factor;
 STATIC prng_seed_t number_random_seed;
-static int number_generate_coprime_init;
+/* the context of the number_*() functions */
+static number_ctx_t number_ctx = { .seed = &number_random_seed };
+
+#ifdef MERSENNE_TWISTER
+#define NUMBER_RANDOM(CTX) ((CTX)->prng ? genrand64_int64_r((CTX)->prng) : \
+	genrand64_int64())
+#else
+#define NUMBER_RANDOM(CTX) ((CTX)->prng ? nrand48((CTX)->prng->xsubi) : \
+	random())
+#endif
 
 static u64 *code2list(code2list_t *list, int code)
 {
@@ -69,7 +65,10 @@ static u64 *code2list(code2list_t *list, int code)
 	return list->code == -1 ? NULL : list->list;
 }
 
-int number_enclevl_set(int level)
+static number_kernels_t *number_kernels_get(int block_sz);
+static number_batch_t *number_batch_get(void);
+
+int number_enclevl_set_r(number_ctx_t *ctx, int level)
 {
 	int *ptr;
 
@@ -77,20 +76,37 @@ int number_enclevl_set(int level)
 	if (!*ptr)
 		return -1;
 
-	encryption_level = level;
-	block_sz_u1024 = encryption_level / bit_sz_u64;
-	number_generate_coprime_init = 0;
+	ctx->level = level;
+	ctx->block_sz = ctx->level / bit_sz_u64;
+	ctx->is_coprime_init = 0;
+	ctx->kernels = number_kernels_get(ctx->block_sz);
+	ctx->batch = number_batch_get();
 
 	return 0;
 }
 
-int number_data2num(u1024_t *num, void *data, int len)
+/* the global context follows the global encryption level, which may also be
+ * set directly */
+static number_ctx_t *number_ctx_global(void)
 {
-	if (len > block_sz_u1024 * sizeof(u64))
+	if (number_ctx.level != encryption_level ||
+		number_ctx.block_sz != block_sz_u1024 || !number_ctx.kernels) {
+		number_ctx.level = encryption_level;
+		number_ctx.block_sz = block_sz_u1024;
+		number_ctx.is_coprime_init = 0;
+		number_ctx.kernels = number_kernels_get(number_ctx.block_sz);
+		number_ctx.batch = number_batch_get();
+	}
+	return &number_ctx;
+}
+
+int number_data2num_r(number_ctx_t *ctx, u1024_t *num, void *data, int len)
+{
+	if (len > ctx->block_sz * sizeof(u64))
 		return -1;
-	number_reset(num);
+	number_reset_r(ctx, num);
 	memcpy(num->arr, data, len);
-	number_top_set(num);
+	number_top_set_r(ctx, num);
 	return 0;
 }
 
@@ -99,107 +115,242 @@ int number_size(int level)
 	return sizeof(int) + (level + bit_sz_u64) / sizeof(u64);
 }
 
-void INLINE number_add(u1024_t *res, u1024_t *num1, u1024_t *num2)
+/* limb level arithmetic: the following operate on len u64s in place. res may be
+ * any of the operands. carries and borrows are taken from the compiler's
+ * overflow builtins */
+
+/* res = a + b, returns the carry out of the most significant limb */
+static u64 ALWAYS_INLINE number_limbs_add(u64 *res, u64 *a, u64 *b, int len)
 {
-	u1024_t num_big, num_small, num_res;
-	u64 *top, *top_max, *seg = NULL, *seg1 = NULL, *seg2 = NULL, carry = 0;
+	u64 carry = 0;
+	int i;
 
-	TIMER_START(FUNC_NUMBER_ADD);
-	/* set num_big => num_small */
-	if (number_is_greater_or_equal(num1, num2)) {
-		number_assign(num_big, *num1);
-		number_assign(num_small, *num2);
+	for (i = 0; i < len; i++) {
+		u64 sum, carry_out = __builtin_add_overflow(a[i], b[i], &sum);
+
+		carry_out |= __builtin_add_overflow(sum, carry, &res[i]);
+		carry = carry_out;
 	}
-	else {
-		number_assign(num_big, *num2);
-		number_assign(num_small, *num1);
-	}
-
-	number_assign(num_res, num_big);
-	top = (u64*)&num_res.arr + num_small.top + 1;
-	for (seg = (u64*)&num_res.arr, seg1 = (u64*)&num_big.arr,
-		seg2 = (u64*)&num_small.arr; seg < top; seg++, seg1++, seg2++) {
-		*seg = *seg1 + *seg2 + carry;
-		if ((*seg1 & MSB(u64)) && (*seg2 & MSB(u64)))
-			carry = 1;
-		else if (!(*seg1 & MSB(u64)) && !(*seg2 & MSB(u64)))
-			carry = 0;
-		else
-			carry = (*seg & MSB(u64)) ? 0 : 1;
+	return carry;
+}
+
+/* res = a + carry, returns the carry out of the most significant limb */
+static u64 INLINE number_limbs_add_carry(u64 *res, u64 *a, int len, u64 carry)
+{
+	int i;
+
+	for (i = 0; i < len; i++)
+		carry = __builtin_add_overflow(a[i], carry, &res[i]);
+	return carry;
+}
+
+/* res = a - b, returns the borrow out of the most significant limb */
+static u64 ALWAYS_INLINE number_limbs_sub(u64 *res, u64 *a, u64 *b, int len)
+{
+	u64 borrow = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		u64 diff, borrow_out;
+
+		borrow_out = __builtin_sub_overflow(a[i], b[i], &diff);
+		borrow_out |= __builtin_sub_overflow(diff, borrow, &res[i]);
+		borrow = borrow_out;
+	}
+	return borrow;
+}
+
+/* res = a + q * b, returns the carry limb out of the most significant limb */
+static u64 ALWAYS_INLINE number_limbs_mul_add(u64 *res, u64 *a, u64 *b, u64 q,
+	int len)
+{
+	u64 carry = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		u128 acc = (u128)q * b[i] + a[i] + carry;
+
+		res[i] = (u64)acc;
+		carry = (u64)(acc >> BIT_SZ_U64);
+	}
+	return carry;
+}
+
+/* res = a - q * b, returns the borrow limb out of the most significant limb */
+static u64 ALWAYS_INLINE number_limbs_mul_sub(u64 *res, u64 *a, u64 *b, u64 q,
+	int len)
+{
+	u64 borrow = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		u128 product = (u128)q * b[i] + borrow;
+
+		borrow = (u64)(product >> BIT_SZ_U64);
+		borrow += __builtin_sub_overflow(a[i], (u64)product, &res[i]);
+	}
+	return borrow;
+}
+
+/* a > b: 1, a < b: -1, a == b: 0 */
+static int ALWAYS_INLINE number_limbs_cmp(u64 *a, u64 *b, int len)
+{
+	while (len--) {
+		if (a[len] != b[len])
+			return a[len] > b[len] ? 1 : -1;
 	}
+	return 0;
+}
+
+/* res = a << n, bits shifted out of the most significant limb are lost */
+static void ALWAYS_INLINE number_limbs_shift_left(u64 *res, u64 *a, int len,
+	int n)
+{
+	int words = n / BIT_SZ_U64, bits = n % BIT_SZ_U64, i;
+
+	for (i = len - 1; i >= words; i--) {
+		res[i] = a[i - words];
+		if (bits) {
+			res[i] = (u64)(res[i] << bits) | (i > words ?
+				(u64)(a[i - words - 1] >> (BIT_SZ_U64 - bits)) :
+				0);
+		}
+	}
+	for ( ; i >= 0; i--)
+		res[i] = 0;
+}
 
-	top_max = (u64*)&num_res.arr + block_sz_u1024;
-	for ( ; carry && seg <= top_max; seg++) {
-		carry = *seg == (u64)-1;
-		(*seg)++;
-		if (seg > (u64*)&num_res.arr + num_res.top)
-			num_res.top++;
+/* res = a >> n */
+static void INLINE number_limbs_shift_right(u64 *res, u64 *a, int len, int n)
+{
+	int words = n / BIT_SZ_U64, bits = n % BIT_SZ_U64, i;
+
+	for (i = 0; i < len - words; i++) {
+		res[i] = a[i + words];
+		if (bits) {
+			res[i] = (u64)(res[i] >> bits) | (i + words + 1 < len ?
+				(u64)(a[i + words + 1] << (BIT_SZ_U64 - bits)) :
+				0);
+		}
 	}
-	if (num_res.top > block_sz_u1024)
-		num_res.top--;
+	for ( ; i < len; i++)
+		res[i] = 0;
+}
+
+/* the sum is kept up to, and including, the u64 buffer. if it overflows the
+ * buffer, the buffer is reset */
+void INLINE number_add_r(number_ctx_t *ctx, u1024_t *res, u1024_t *num1,
+	u1024_t *num2)
+{
+	u64 *buffer = (u64*)&res->arr + ctx->block_sz, carry;
+
+	TIMER_START(FUNC_NUMBER_ADD);
+	carry = ctx->kernels->add((u64*)&res->arr, (u64*)&num1->arr,
+		(u64*)&num2->arr, ctx->block_sz);
+	carry = number_limbs_add(buffer, (u64*)&num1->arr + ctx->block_sz,
+		(u64*)&num2->arr + ctx->block_sz, 1) |
+		number_limbs_add_carry(buffer, buffer, 1, carry);
 	if (carry)
-		number_reset_buffer(&num_res);
-	number_assign(*res, num_res);
+		*buffer = 0;
+	number_top_set_r(ctx, res);
 	TIMER_STOP(FUNC_NUMBER_ADD);
 }
 
-static prng_seed_t number_seed_set(prng_seed_t seed)
+static prng_seed_t number_seed_set_r(number_ctx_t *ctx, prng_seed_t seed)
 {
-	if (!(number_random_seed = seed)) {
+	if (!(*ctx->seed = seed)) {
 		struct timeval tv;
 
 		tv.tv_sec = tv.tv_usec = 0;
 		if (gettimeofday(&tv, NULL))
 			return 0;
-		number_random_seed =
-			(prng_seed_t)tv.tv_sec * (prng_seed_t)tv.tv_usec;
+		*ctx->seed = (prng_seed_t)tv.tv_sec * (prng_seed_t)tv.tv_usec;
 	}
 
 #ifdef MERSENNE_TWISTER
-	init_genrand64(number_random_seed);
+	if (ctx->prng)
+		init_genrand64_r(ctx->prng, *ctx->seed);
+	else
+		init_genrand64(*ctx->seed);
 #else
-	srandom(number_random_seed);
+	if (ctx->prng) {
+		/* as seeded by srand48() */
+		ctx->prng->xsubi[0] = 0x330e;
+		ctx->prng->xsubi[1] = (unsigned short)*ctx->seed;
+		ctx->prng->xsubi[2] = (unsigned short)(*ctx->seed >> 16);
+	}
+	else {
+		srandom(*ctx->seed);
+	}
 #endif
-	return number_random_seed;
+	return *ctx->seed;
 }
 
-int number_seed_set_random(u1024_t *seed)
+int number_seed_set_random_r(number_ctx_t *ctx, u1024_t *seed)
 {
-	if (!number_seed_set(0))
+	if (!number_seed_set_r(ctx, 0))
 		return -1;
-	number_reset(seed);
-	return number_data2num(seed, &number_random_seed, sizeof(prng_seed_t));
+	number_reset_r(ctx, seed);
+	return number_data2num_r(ctx, seed, ctx->seed, sizeof(prng_seed_t));
 }
 
-int number_seed_set_fixed(u1024_t *seed)
+int number_seed_set_fixed_r(number_ctx_t *ctx, u1024_t *seed)
+{
+	return number_seed_set_r(ctx, *(prng_seed_t*)&seed->arr) ? 0 : -1;
+}
+
+/* initiates ctx at level with a random number generator of its own, seeded by
+ * seed, or by the time of day if seed is 0 */
+int number_ctx_init(number_ctx_t *ctx, int level, prng_seed_t seed)
+{
+	memset(ctx, 0, sizeof(number_ctx_t));
+	if (number_enclevl_set_r(ctx, level))
+		return -1;
+
+	ctx->prng = &ctx->prng_state;
+	ctx->seed = &ctx->prng_seed;
+	return number_seed_set_r(ctx, seed) ? 0 : -1;
+}
+
+/* initiates child at level with a random number generator of its own, seeded
+ * by a draw from that of ctx, whatever the level of ctx */
+int number_ctx_child_init_r(number_ctx_t *ctx, number_ctx_t *child, int level)
 {
-	return number_seed_set(*(prng_seed_t*)&seed->arr) ? 0 : -1;
+	prng_seed_t seed;
+
+	if (!*ctx->seed && !number_seed_set_r(ctx, 0))
+		return -1;
+
+	/* a seed of 0 would be taken from the time of day */
+	while (!(seed = (prng_seed_t)NUMBER_RANDOM(ctx)));
+	return number_ctx_init(child, level, seed);
 }
 
 /* initiates the first low (u64) blocks of num with random values */
-int INLINE number_init_random(u1024_t *num, int blocks)
+int INLINE number_init_random_r(number_ctx_t *ctx, u1024_t *num, int blocks)
 {
 	int i, ret;
 
 	TIMER_START(FUNC_NUMBER_INIT_RANDOM);
-	if (blocks < 1 || blocks > block_sz_u1024 || (!number_random_seed &&
-		!number_seed_set(0))) {
+	if (blocks < 1 || blocks > ctx->block_sz || (!*ctx->seed &&
+		!number_seed_set_r(ctx, 0))) {
 		ret = -1;
 		goto Exit;
 	}
 
-	number_reset(num);
+	number_reset_r(ctx, num);
 
 	/* initiate the low u64 blocks of num */
 	for (i = 0; i < blocks; i++) {
-		*((u64*)&num->arr + i) = RSA_RANDOM();
+		*((u64*)&num->arr + i) = NUMBER_RANDOM(ctx);
 #if !defined(MERSENNE_TWISTER) && defined(ULLONG)
 		/* random() returns a long int so another call is required to
 		 * fill the block's higher bits */
-		*((u64*)&num->arr + i) |= (u64)random()<<(bit_sz_u64/2);
+		*((u64*)&num->arr + i) |=
+			(u64)NUMBER_RANDOM(ctx)<<(BIT_SZ_U64/2);
 #endif
 	}
-	number_top_set(num);
+	number_top_set_r(ctx, num);
 	ret = 0;
 
 Exit:
@@ -207,6 +358,39 @@ Exit:
 	return ret;
 }
 
+/* shifting is done up to, and including, the u64 buffer */
+STATIC void INLINE number_shift_right_r(number_ctx_t *ctx, u1024_t *num, int n)
+{
+	TIMER_START(FUNC_NUMBER_SHIFT_RIGHT);
+	number_limbs_shift_right((u64*)&num->arr, (u64*)&num->arr,
+		ctx->block_sz + 1, n);
+	number_top_set_r(ctx, num);
+	TIMER_STOP(FUNC_NUMBER_SHIFT_RIGHT);
+}
+
+STATIC void INLINE number_shift_left_r(number_ctx_t *ctx, u1024_t *num, int n)
+{
+	TIMER_START(FUNC_NUMBER_SHIFT_LEFT);
+	number_limbs_shift_left((u64*)&num->arr, (u64*)&num->arr,
+		ctx->block_sz + 1, n);
+	number_top_set_r(ctx, num);
+	TIMER_STOP(FUNC_NUMBER_SHIFT_LEFT);
+}
+
+/* returns the number of trailing zero bits in num, or 0 if num is zero */
+static int INLINE number_trailing_zeros(u1024_t *num)
+{
+	u64 *seg, *top = (u64*)&num->arr + num->top;
+
+	for (seg = (u64*)&num->arr; seg < top && !*seg; seg++);
+	return *seg ? (seg - (u64*)&num->arr) * BIT_SZ_U64 + U64_CTZ(*seg) :
+		0;
+}
+
+/* major: the most significant non zero u64 of num
+ * minor: a mask of the most significant set bit in major, or 0 if num is zero
+ * returns the offset of minor in major, 1 for the least significant bit, or 0
+ * if num is zero */
 STATIC int INLINE number_find_most_significant_set_bit(u1024_t *num,
 	u64 **major, u64 *minor)
 {
@@ -214,200 +398,516 @@ STATIC int INLINE number_find_most_significant_set_bit(u1024_t *num,
 
 	TIMER_START(FUNC_NUMBER_FIND_MOST_SIGNIFICANT_SET_BIT);
 	*major = (u64*)&num->arr + num->top;
-	*minor = MSB(u64);
-	minor_offset = bit_sz_u64;
-
-	while (*minor) {
-		if ((**major & *minor))
-			break;
-		*minor = *minor >> 1;
-		minor_offset--;
+	if (**major) {
+		minor_offset = U64_MSB_IDX(**major) + 1;
+		*minor = (u64)1 << (minor_offset - 1);
+	}
+	else {
+		minor_offset = 0;
+		*minor = 0;
 	}
 	TIMER_STOP(FUNC_NUMBER_FIND_MOST_SIGNIFICANT_SET_BIT);
 	return minor_offset;
 }
 
-void INLINE number_small_dec2num(u1024_t *num_n, u64 dec)
+/* the number of significant bits in num */
+static int INLINE number_bit_len(u1024_t *num)
+{
+	u64 *major, minor;
+
+	return num->top * BIT_SZ_U64 +
+		number_find_most_significant_set_bit(num, &major, &minor);
+}
+
+void INLINE number_small_dec2num_r(number_ctx_t *ctx, u1024_t *num_n, u64 dec)
 {
 	u64 zero = (u64)0;
 	u64 *ptr = &zero;
 
 	TIMER_START(FUNC_NUMBER_SMALL_DEC2NUM);
-	number_reset(num_n);
+	number_reset_r(ctx, num_n);
 	*(u64 *)&num_n->arr = (u64)(*ptr | dec);
 	TIMER_STOP(FUNC_NUMBER_SMALL_DEC2NUM);
 }
 
-STATIC void INLINE number_2complement(u1024_t *res, u1024_t *num)
+/* the difference is taken modulo 2^level, so a negative result is in two's
+ * complement form. the u64 buffer is reset */
+void INLINE number_sub_r(number_ctx_t *ctx, u1024_t *res, u1024_t *num1,
+	u1024_t *num2)
 {
-	u1024_t tmp;
-	u64 *seg = NULL, *seg_max = (u64 *)&tmp.arr + block_sz_u1024;
-	int cur_block;
-
-	TIMER_START(FUNC_NUMBER_2COMPLEMENT);
-	number_assign(tmp, *num);
-	for (seg = (u64 *)&tmp.arr, cur_block = 0; seg <= seg_max; seg++,
-		cur_block++) {
-		if ((*seg = ~*seg)) /* one's complement */
-			tmp.top = cur_block;
-	}
-
-	number_add(res, &tmp, &NUM_1); /* two's complement */
-	TIMER_STOP(FUNC_NUMBER_2COMPLEMENT);
+	TIMER_START(FUNC_NUMBER_SUB);
+	ctx->kernels->sub((u64*)&res->arr, (u64*)&num1->arr,
+		(u64*)&num2->arr, ctx->block_sz);
+	*((u64*)&res->arr + ctx->block_sz) = 0;
+	number_top_set_r(ctx, res);
+	TIMER_STOP(FUNC_NUMBER_SUB);
 }
 
-void INLINE number_sub(u1024_t *res, u1024_t *num1, u1024_t *num2)
+/* schoolbook multiplication: res = a * b, where a and b are len_a and len_b
+ * limbs long. the product is truncated to the low len limbs of res. each
+ * partial product is accumulated in a u128, whose high half is the carry into
+ * the next limb. res must not overlap a or b */
+static void ALWAYS_INLINE number_limbs_mul(u64 *res, int len, u64 *a,
+	int len_a, u64 *b, int len_b)
 {
-	u1024_t num2_2complement;
+	int i, j;
 
-	TIMER_START(FUNC_NUMBER_SUB);
-	number_2complement(&num2_2complement, num2);
-	number_add(res, num1, &num2_2complement);
-	number_reset_buffer(res);
-	TIMER_STOP(FUNC_NUMBER_SUB);
+	memset(res, 0, len * sizeof(u64));
+	for (i = 0; i < len_b && i < len; i++) {
+		u64 carry = 0;
+
+		if (!b[i])
+			continue;
+
+		for (j = 0; j < len_a && i + j < len; j++) {
+			u128 acc = (u128)a[j] * b[i] + res[i + j] + carry;
+
+			res[i + j] = (u64)acc;
+			carry = (u64)(acc >> BIT_SZ_U64);
+		}
+		if (i + j < len)
+			res[i + j] = carry;
+	}
 }
 
-void INLINE number_mul(u1024_t *res, u1024_t *num1, u1024_t *num2)
+/* the product is kept up to, and including, the u64 buffer.
+ * operands within block_sz limbs, whose product fills them, are multiplied by
+ * the block_sz kernel */
+void INLINE number_mul_r(number_ctx_t *ctx, u1024_t *res, u1024_t *num1,
+	u1024_t *num2)
 {
-	int i, top;
-	u1024_t tmp_res, multiplicand = *num1, multiplier = *num2;
+	u64 product[RSA_NUMBER_ARRAY_SZ];
+	int len1 = num1->top + 1, len2 = num2->top + 1;
 
 	TIMER_START(FUNC_NUMBER_MUL);
-	number_reset(&tmp_res);
-	top = num1->top + num2->top + 1;
-	for (i = 0; i < top; i++) {
-		u64 mask = 1;
-		int j;
-
-		for (j = 0; j < bit_sz_u64; j++) {
-			if ((*((u64*)&multiplier.arr + i)) & mask)
-				number_add(&tmp_res, &tmp_res, &multiplicand);
-			number_shift_left_once(&multiplicand);
-			number_reset_buffer(&multiplicand);
-			mask = mask << 1;
-		}
+	if (len1 <= ctx->block_sz && len2 <= ctx->block_sz &&
+		len1 + len2 > ctx->block_sz) {
+		ctx->kernels->mul(product, (u64*)&num1->arr,
+			(u64*)&num2->arr, ctx->block_sz);
 	}
-	number_assign(*res, tmp_res);
+	else {
+		number_limbs_mul(product, ctx->block_sz + 1, (u64*)&num1->arr,
+			len1, (u64*)&num2->arr, len2);
+	}
+	memcpy(res->arr, product, (ctx->block_sz + 1) * sizeof(u64));
+	number_top_set_r(ctx, res);
 	TIMER_STOP(FUNC_NUMBER_MUL);
 }
 
-STATIC void INLINE number_absolute_value(u1024_t *abs, u1024_t *num)
+/* res += q * num, over block_sz + 1 limbs as number_mul_r() and
+ * number_add_r(), by a single pass over num */
+void INLINE number_mul_small_add_r(number_ctx_t *ctx, u1024_t *res,
+	u1024_t *num, u64 q)
+{
+	TIMER_START(FUNC_NUMBER_MUL_SMALL_ADD);
+	number_limbs_mul_add((u64*)&res->arr, (u64*)&res->arr,
+		(u64*)&num->arr, q, ctx->block_sz + 1);
+	number_top_set_r(ctx, res);
+	TIMER_STOP(FUNC_NUMBER_MUL_SMALL_ADD);
+}
+
+STATIC void INLINE number_absolute_value_r(number_ctx_t *ctx, u1024_t *abs,
+	u1024_t *num)
 {
 	TIMER_START(FUNC_NUMBER_ABSOLUTE_VALUE);
-	number_assign(*abs, *num);
-	if (NUMBER_IS_NEGATIVE(num)) {
+	number_assign_r(ctx, *abs, *num);
+	if (NUMBER_IS_NEGATIVE_R(ctx, num)) {
 		u64 *seg;
 
-		number_sub(abs, abs, &NUM_1);
-		for (seg = (u64*)&abs->arr + block_sz_u1024 - 1;
+		number_sub_r(ctx, abs, abs, &NUM_1);
+		for (seg = (u64*)&abs->arr + ctx->block_sz - 1;
 			seg >= (u64*)&abs->arr; seg--) {
 			*seg = ~*seg;
 		}
-		number_top_set(abs);
+		number_top_set_r(ctx, abs);
 	}
 	TIMER_STOP(FUNC_NUMBER_ABSOLUTE_VALUE);
 }
 
-void INLINE number_dev(u1024_t *num_q, u1024_t *num_r, u1024_t *num_dividend,
-	u1024_t *num_divisor)
+/* knuth's algorithm D (TAOCP vol. 2, 4.3.1): q = u / v, r = u % v.
+ * u is len_u limbs long, at most 2*RSA_NUMBER_ARRAY_SZ, v is len_v limbs long
+ * with a non zero most significant limb, and len_u >= len_v. q receives
+ * len_u - len_v + 1 limbs, r receives len_v limbs.
+ * both operands are first normalised by the shift that sets v's most
+ * significant bit, so each quotient limb estimate, taken from the remainder's
+ * top two limbs, is at most 2 larger than the true quotient limb */
+static void number_limbs_dev(u64 *q, u64 *r, u64 *u, int len_u, u64 *v,
+	int len_v)
 {
-	u1024_t dividend, divisor, quotient, remainder;
-	u64 *seg_dividend = (u64 *)&dividend.arr + block_sz_u1024 - 1;
-	u64 *remainder_ptr = (u64 *)&remainder.arr;
-	u64 *quotient_ptr = (u64 *)&quotient.arr;
+	u64 un[2 * RSA_NUMBER_ARRAY_SZ + 1], vn[RSA_NUMBER_ARRAY_SZ];
+	int shift, i, j;
+
+	/* short division by a single limb */
+	if (len_v == 1) {
+		u64 rem = 0;
+
+		for (j = len_u - 1; j >= 0; j--) {
+			u128 num = (u128)rem << BIT_SZ_U64 | u[j];
+
+			q[j] = (u64)(num / v[0]);
+			rem = (u64)(num % v[0]);
+		}
+		r[0] = rem;
+		return;
+	}
+
+	/* D1: normalise */
+	shift = BIT_SZ_U64 - 1 - U64_MSB_IDX(v[len_v - 1]);
+	for (i = len_v - 1; i > 0; i--) {
+		vn[i] = shift ? (u64)(v[i] << shift) |
+			(u64)(v[i - 1] >> (BIT_SZ_U64 - shift)) : v[i];
+	}
+	vn[0] = (u64)(v[0] << shift);
+	un[len_u] = shift ? (u64)(u[len_u - 1] >> (BIT_SZ_U64 - shift)) : 0;
+	for (i = len_u - 1; i > 0; i--) {
+		un[i] = shift ? (u64)(u[i] << shift) |
+			(u64)(u[i - 1] >> (BIT_SZ_U64 - shift)) : u[i];
+	}
+	un[0] = (u64)(u[0] << shift);
+
+	for (j = len_u - len_v; j >= 0; j--) {
+		u128 num, qhat, rhat;
+		u64 carry = 0, borrow = 0, top;
+		int is_negative;
+
+		/* D3: estimate q(j) and correct it against the third limb */
+		num = (u128)un[j + len_v] << BIT_SZ_U64 | un[j + len_v - 1];
+		qhat = num / vn[len_v - 1];
+		rhat = num % vn[len_v - 1];
+		while (qhat >> BIT_SZ_U64 || qhat * vn[len_v - 2] >
+			((rhat << BIT_SZ_U64) | un[j + len_v - 2])) {
+			qhat--;
+			rhat += vn[len_v - 1];
+			if (rhat >> BIT_SZ_U64)
+				break;
+		}
+
+		/* D4: multiply and subtract */
+		for (i = 0; i < len_v; i++) {
+			u128 product = qhat * vn[i] + carry;
+			u64 low = (u64)product, diff = un[i + j] - low;
+			u64 borrow_out = un[i + j] < low || diff < borrow;
+
+			carry = (u64)(product >> BIT_SZ_U64);
+			un[i + j] = diff - borrow;
+			borrow = borrow_out;
+		}
+		top = un[j + len_v] - carry;
+		is_negative = un[j + len_v] < carry || top < borrow;
+		un[j + len_v] = top - borrow;
+		q[j] = (u64)qhat;
+
+		/* D6: add back, q(j) was one too large */
+		if (is_negative) {
+			q[j]--;
+			un[j + len_v] += number_limbs_add(un + j, un + j, vn,
+				len_v);
+		}
+	}
+
+	/* D8: unnormalise the remainder */
+	for (i = 0; i < len_v - 1; i++) {
+		r[i] = shift ? (u64)(un[i] >> shift) |
+			(u64)(un[i + 1] << (BIT_SZ_U64 - shift)) : un[i];
+	}
+	r[len_v - 1] = (u64)(un[len_v - 1] >> shift);
+}
+
+/* only the low block_sz u64s of num_dividend are divided. dividing by zero
+ * results in an all ones quotient and the dividend as the remainder.
+ * num_q and num_r may be any of num_dividend and num_divisor */
+void INLINE number_dev_r(number_ctx_t *ctx, u1024_t *num_q, u1024_t *num_r,
+	u1024_t *num_dividend, u1024_t *num_divisor)
+{
+	u64 quotient[RSA_NUMBER_ARRAY_SZ], remainder[RSA_NUMBER_ARRAY_SZ];
+	u64 *u = (u64*)&num_dividend->arr, *v = (u64*)&num_divisor->arr;
+	int len_u, len_v;
 
 	TIMER_START(FUNC_NUMBER_DEV);
-	number_assign(dividend, *num_dividend);
-	number_assign(divisor, *num_divisor);
-	number_reset(&remainder);
-	number_reset(&quotient);
-	while (seg_dividend >= (u64 *)&dividend) {
-		u64 mask_dividend = MSB(u64);
+	for (len_u = ctx->block_sz; len_u && !u[len_u - 1]; len_u--);
+	for (len_v = ctx->block_sz + 1; len_v && !v[len_v - 1]; len_v--);
+
+	memset(quotient, 0, sizeof(quotient));
+	memset(remainder, 0, sizeof(remainder));
+	if (!len_v) {
+		memset(quotient, 0xff, ctx->block_sz * sizeof(u64));
+		memcpy(remainder, u, len_u * sizeof(u64));
+	}
+	else if (len_u < len_v) {
+		memcpy(remainder, u, len_u * sizeof(u64));
+	}
+	else {
+		number_limbs_dev(quotient, remainder, u, len_u, v, len_v);
+	}
 
-		while (mask_dividend) {
-			number_shift_left_once(&remainder);
-			number_reset_buffer(&remainder);
-			number_shift_left_once(&quotient);
-			number_reset_buffer(&quotient);
-			*remainder_ptr = *remainder_ptr |
-				((*seg_dividend & mask_dividend) ?
-				 (u64)1 : (u64)0);
-			if (number_is_greater_or_equal(&remainder, &divisor)){
-				*quotient_ptr = *quotient_ptr | (u64)1;
-				number_sub(&remainder, &remainder, &divisor);
+	memcpy(num_q->arr, quotient, (ctx->block_sz + 1) * sizeof(u64));
+	number_top_set_r(ctx, num_q);
+	memcpy(num_r->arr, remainder, (ctx->block_sz + 1) * sizeof(u64));
+	number_top_set_r(ctx, num_r);
+	TIMER_STOP(FUNC_NUMBER_DEV);
+}
+
+/* bits [s, s + BIT_SZ_U64) of a, len limbs long */
+static u64 ALWAYS_INLINE number_limbs_bits(u64 *a, int len, int s)
+{
+	int limb = s / BIT_SZ_U64, shift = s % BIT_SZ_U64;
+	u64 bits = limb < len ? a[limb] >> shift : 0;
+
+	if (shift && limb + 1 < len)
+		bits |= a[limb + 1] << (BIT_SZ_U64 - shift);
+	return bits;
+}
+
+/* num_r = num_dividend % num_divisor, returns num_dividend / num_divisor, for a
+ * quotient of a single limb.
+ * with both operands shifted right by s bits, leaving the divisor's most
+ * significant limb normalised, the quotient is estimated from the dividend's
+ * top two limbs. as in number_limbs_dev(), the estimate is at most 2 larger
+ * than the quotient, and is corrected by adding back the divisor. so a single
+ * multiply and subtract pass replaces the long division. num_r may be
+ * num_dividend. quotients that may exceed a limb are left to number_dev_r(),
+ * and only their low limb is returned */
+u64 INLINE number_dev_small_r(number_ctx_t *ctx, u1024_t *num_r,
+	u1024_t *num_dividend, u1024_t *num_divisor)
+{
+	u64 remainder[RSA_NUMBER_ARRAY_SZ], *u = (u64*)&num_dividend->arr;
+	u64 *v = (u64*)&num_divisor->arr, q, top;
+	int len_u, len_v, s;
+	u128 qhat;
+
+	for (len_u = ctx->block_sz; len_u && !u[len_u - 1]; len_u--);
+	for (len_v = ctx->block_sz; len_v && !v[len_v - 1]; len_v--);
+	if (len_v < 2 || len_u > len_v + 1 || (len_u == len_v + 1 &&
+		u[len_v] >= v[len_v - 1])) {
+		u1024_t num_q;
+
+		number_dev_r(ctx, &num_q, num_r, num_dividend, num_divisor);
+		return *(u64*)&num_q.arr;
+	}
+
+	TIMER_START(FUNC_NUMBER_DEV_SMALL);
+	s = (len_v - 1) * BIT_SZ_U64 + U64_MSB_IDX(v[len_v - 1]) + 1 -
+		BIT_SZ_U64;
+	qhat = ((u128)number_limbs_bits(u, len_u, s + BIT_SZ_U64) <<
+		BIT_SZ_U64 | number_limbs_bits(u, len_u, s)) /
+		number_limbs_bits(v, len_v, s);
+	q = qhat >> BIT_SZ_U64 ? ~(u64)0 : (u64)qhat;
+
+	top = (len_u > len_v ? u[len_v] : 0) -
+		number_limbs_mul_sub(remainder, u, v, q, len_v);
+	while (top & MSB(u64)) {
+		q--;
+		top += number_limbs_add(remainder, remainder, v, len_v);
+	}
+
+	memset(num_r->arr, 0, (ctx->block_sz + 1) * sizeof(u64));
+	memcpy(num_r->arr, remainder, len_v * sizeof(u64));
+	number_top_set_r(ctx, num_r);
+	TIMER_STOP(FUNC_NUMBER_DEV_SMALL);
+	return q;
+}
+
+/* returns num % d, d != 0, by a single pass of double limb by limb divisions
+ * over the low block_sz limbs of num */
+u64 INLINE number_mod_small_r(number_ctx_t *ctx, u1024_t *num, u64 d)
+{
+	u64 *u = (u64*)&num->arr, rem = 0;
+	int i;
+
+	TIMER_START(FUNC_NUMBER_MOD_SMALL);
+	for (i = ctx->block_sz - 1; i >= 0; i--)
+		rem = (u64)(((u128)rem << BIT_SZ_U64 | u[i]) % d);
+	TIMER_STOP(FUNC_NUMBER_MOD_SMALL);
+	return rem;
+}
+
+/* rem[i] = num % d[i], for count divisors, none 0. the divisors are grouped
+ * into products that fit in a limb, so num is passed over once per group
+ * rather than once per divisor, and each remainder is taken from that of its
+ * group's product. the first 13 primes make up a single group */
+void number_mod_small_many_r(number_ctx_t *ctx, u64 *rem, u1024_t *num,
+	u64 *d, int count)
+{
+	int i, j;
+
+	for (i = 0; i < count; i = j) {
+		u64 product = d[i], next, rem_product;
+
+		for (j = i + 1; j < count &&
+			!__builtin_mul_overflow(product, d[j], &next); j++) {
+			product = next;
+		}
+		rem_product = number_mod_small_r(ctx, num, product);
+		for ( ; i < j; i++)
+			rem[i] = rem_product % d[i];
+	}
+}
+
+/* sets barrett's modulus to num_n, computing mu by a single long division.
+ * reductions by 0 are left to number_mod_r() */
+void number_barrett_set_r(number_ctx_t *ctx, barrett_ctx_t *barrett,
+	u1024_t *num_n)
+{
+	u64 power[2 * RSA_NUMBER_ARRAY_SZ], quotient[2 * RSA_NUMBER_ARRAY_SZ];
+	u64 remainder[RSA_NUMBER_ARRAY_SZ], *n = (u64*)&num_n->arr;
+	int k;
+
+	for (k = ctx->block_sz; k && !n[k - 1]; k--);
+	number_assign_r(ctx, barrett->n, *num_n);
+	barrett->k = k;
+
+	if (!k)
+		return;
+
+	memset(power, 0, (2 * k + 1) * sizeof(u64));
+	power[2 * k] = 1;
+	number_limbs_dev(quotient, remainder, power, 2 * k + 1, n, k);
+	memcpy(barrett->mu, quotient, (k + 1) * sizeof(u64));
+}
+
+/* barrett reduction (HAC 14.42): num_r = num_x % n, for the modulus n, of k
+ * limbs, set by number_barrett_set_r().
+ *   q = ((x / B^(k-1)) * mu) / B^(k+1), at most 2 smaller than x / n
+ *   r = (x - q*n) % B^(k+1)
+ *   while r >= n do
+ *     r = r - n
+ *   end while
+ * two products, of which only the high and the low limbs are needed, replace a
+ * long division. as with number_mod_r(), only the low block_sz limbs of x are
+ * reduced, and x of more than 2k limbs is left to number_mod_r().
+ * num_r may be num_x */
+void INLINE number_barrett_reduce_r(number_ctx_t *ctx, u1024_t *num_r,
+	u1024_t *num_x, barrett_ctx_t *barrett)
+{
+	u64 q[2 * RSA_NUMBER_ARRAY_SZ + 2], r[RSA_NUMBER_ARRAY_SZ + 1];
+	u64 qn[RSA_NUMBER_ARRAY_SZ + 1], *x = (u64*)&num_x->arr;
+	u64 *n = (u64*)&barrett->n.arr;
+	int k = barrett->k, len_x;
+
+	for (len_x = ctx->block_sz; len_x && !x[len_x - 1]; len_x--);
+	if (len_x > 2 * k || !k) {
+		number_mod_r(ctx, num_r, num_x, &barrett->n);
+		return;
+	}
+
+	TIMER_START(FUNC_NUMBER_BARRETT_REDUCE);
+	memset(r, 0, (k + 1) * sizeof(u64));
+	memcpy(r, x, (len_x < k + 1 ? len_x : k + 1) * sizeof(u64));
+	if (len_x >= k) {
+		number_limbs_mul(q, 2 * k + 2, x + k - 1, len_x - k + 1,
+			barrett->mu, k + 1);
+		number_limbs_mul(qn, k + 1, q + k + 1, k + 1, n, k);
+		number_limbs_sub(r, r, qn, k + 1);
+	}
+	while (r[k] || number_limbs_cmp(r, n, k) >= 0)
+		r[k] -= number_limbs_sub(r, r, n, k);
+
+	memset(num_r->arr, 0, (ctx->block_sz + 1) * sizeof(u64));
+	memcpy(num_r->arr, r, k * sizeof(u64));
+	number_top_set_r(ctx, num_r);
+	TIMER_STOP(FUNC_NUMBER_BARRETT_REDUCE);
+}
+
+/* number_modular_exponentiation_naive_r() by repeated barrett reductions */
+static void number_modular_exponentiation_barrett_r(number_ctx_t *ctx,
+	u1024_t *res, u1024_t *a, u1024_t *b, barrett_ctx_t *barrett)
+{
+	u1024_t d;
+	u64 *seg = NULL, mask;
+
+	number_assign_r(ctx, d, NUM_1);
+	number_find_most_significant_set_bit(b, &seg, &mask);
+	while (seg >= (u64*)&b->arr) {
+		while (mask) {
+			number_mul_r(ctx, &d, &d, &d);
+			number_barrett_reduce_r(ctx, &d, &d, barrett);
+			if (*seg & mask) {
+				number_mul_r(ctx, &d, &d, a);
+				number_barrett_reduce_r(ctx, &d, &d, barrett);
 			}
-			mask_dividend = mask_dividend >> 1;
+
+			mask = mask >> 1;
 		}
-		seg_dividend--;
+		mask = MSB(u64);
+		seg--;
 	}
-	number_assign(*num_q, quotient);
-	number_assign(*num_r, remainder);
-	TIMER_STOP(FUNC_NUMBER_DEV);
+	number_assign_r(ctx, *res, d);
 }
 
-STATIC int INLINE number_modular_multiplication_naive(u1024_t *num_res,
-	u1024_t *num_a, u1024_t *num_b, u1024_t *num_n)
+STATIC int INLINE number_modular_multiplication_naive_r(number_ctx_t *ctx,
+	u1024_t *num_res, u1024_t *num_a, u1024_t *num_b, u1024_t *num_n)
 {
 	u1024_t tmp;
 
 	TIMER_START(FUNC_NUMBER_MODULAR_MULTIPLICATION_NAIVE);
-	number_mul(&tmp, num_a, num_b);
-	number_mod(num_res, &tmp, num_n);
-	number_reset_buffer(num_res);
+	number_mul_r(ctx, &tmp, num_a, num_b);
+	number_mod_r(ctx, num_res, &tmp, num_n);
+	number_reset_buffer_r(ctx, num_res);
 	TIMER_STOP(FUNC_NUMBER_MODULAR_MULTIPLICATION_NAIVE);
 	return 0;
 }
 
-/* assigns num_n: 0 < num_n < range */
-static void INLINE number_init_random_strict_range(u1024_t *num_n,
-	u1024_t *range)
+static void number_strict_range_set_r(number_ctx_t *ctx,
+	barrett_ctx_t *range_min1, u1024_t *range)
+{
+	u1024_t num_range_min1;
+
+	number_sub_r(ctx, &num_range_min1, range, &NUM_1);
+	number_barrett_set_r(ctx, range_min1, &num_range_min1);
+}
+
+/* assigns num_n: 0 < num_n < range, by the barrett context of range - 1, as
+ * set by number_strict_range_set_r() once for many random numbers */
+static void INLINE number_init_random_strict_range_r(number_ctx_t *ctx,
+	u1024_t *num_n, barrett_ctx_t *range_min1)
 {
-	u1024_t num_tmp, num_range_min1;
+	u1024_t num_tmp;
 
 	TIMER_START(FUNC_NUMBER_INIT_RANDOM_STRICT_RANGE);
-	number_sub(&num_range_min1, range, &NUM_1);
-	number_init_random(&num_tmp, block_sz_u1024);
-	number_mod(&num_tmp, &num_tmp, &num_range_min1);
-	number_add(&num_tmp, &num_tmp, &NUM_1);
+	number_init_random_r(ctx, &num_tmp, ctx->block_sz);
+	number_barrett_reduce_r(ctx, &num_tmp, &num_tmp, range_min1);
+	number_add_r(ctx, &num_tmp, &num_tmp, &NUM_1);
 
-	number_assign(*num_n, num_tmp);
+	number_assign_r(ctx, *num_n, num_tmp);
 	TIMER_STOP(FUNC_NUMBER_INIT_RANDOM_STRICT_RANGE);
 }
 
-STATIC void INLINE number_exponentiation(u1024_t *res, u1024_t *num_base,
-	u1024_t *num_exp)
+STATIC void INLINE number_exponentiation_r(number_ctx_t *ctx, u1024_t *res,
+	u1024_t *num_base, u1024_t *num_exp)
 {
 	u1024_t num_cnt, num_tmp;
 
 	TIMER_START(FUNC_NUMBER_EXPONENTIATION);
-	number_assign(num_cnt, NUM_0);
-	number_assign(num_tmp, NUM_1);
+	number_assign_r(ctx, num_cnt, NUM_0);
+	number_assign_r(ctx, num_tmp, NUM_1);
 
-	while (!number_is_equal(&num_cnt, num_exp)) {
-		number_mul(&num_tmp, &num_tmp, num_base);
-		number_add(&num_cnt, &num_cnt, &NUM_1);
+	while (!number_is_equal_r(ctx, &num_cnt, num_exp)) {
+		number_mul_r(ctx, &num_tmp, &num_tmp, num_base);
+		number_add_r(ctx, &num_cnt, &num_cnt, &NUM_1);
 	}
 
-	number_assign(*res, num_tmp);
+	number_assign_r(ctx, *res, num_tmp);
 	TIMER_STOP(FUNC_NUMBER_EXPONENTIATION);
 }
 
-STATIC int INLINE number_modular_exponentiation_naive(u1024_t *res, u1024_t *a,
-	u1024_t *b, u1024_t *n)
+STATIC int INLINE number_modular_exponentiation_naive_r(number_ctx_t *ctx,
+	u1024_t *res, u1024_t *a, u1024_t *b, u1024_t *n)
 {
 	u1024_t d;
 	u64 *seg = NULL, mask;
 
 	TIMER_START(FUNC_NUMBER_MODULAR_EXPONENTIATION_NAIVE);
-	number_assign(d, NUM_1);
+	number_assign_r(ctx, d, NUM_1);
 	number_find_most_significant_set_bit(b, &seg, &mask);
 	while (seg >= (u64*)&b->arr) {
 		while (mask) {
-			if (number_modular_multiplication_naive(&d, &d, &d, n))
+			if (number_modular_multiplication_naive_r(ctx, &d, &d,
+				&d, n)) {
 				return -1;
+			}
 			if ((*seg & mask) &&
-				number_modular_multiplication_naive(&d, &d, a,
-				n)) {
+				number_modular_multiplication_naive_r(ctx, &d,
+				&d, a, n)) {
 				return -1;
 			}
 
@@ -416,242 +916,1141 @@ STATIC int INLINE number_modular_exponentiation_naive(u1024_t *res, u1024_t *a,
 		mask = MSB(u64);
 		seg--;
 	}
-	number_assign(*res, d);
+	number_assign_r(ctx, *res, d);
 	TIMER_STOP(FUNC_NUMBER_MODULAR_EXPONENTIATION_NAIVE);
 	return 0;
 }
 
-/* montgomery product
- * MonPro(a, b, n)
- *   s(-1) = 0
- *   a = 2a
- *   for i = 0 to n do
- *     q(i) = s(i-1) mod 2 (LSB of s(i-1))
- *     s(i) = (s(i-1) + q(i)n + b(i)a)/2
- *   end for
- *   return s(n)
- */
-static void INLINE number_montgomery_product(u1024_t *num_res, u1024_t *num_a,
-	u1024_t *num_b, u1024_t *num_n)
+/* -n^-1 mod 2^BIT_SZ_U64, for an odd n0.
+ * newton's iteration x = x(2 - n0*x) doubles the number of correct low bits of
+ * x = n0^-1 per step, and n0*n0 = 1 mod 8 for any odd n0 */
+static u64 number_montgomery_n0_inv(u64 n0)
 {
-	u1024_t multiplier, num_s;
-	u64 *seg = NULL, *top = (u64*)&num_b->arr + block_sz_u1024;
+	u64 x = n0;
 	int i;
 
-	TIMER_START(FUNC_NUMBER_MONTGOMERY_PRODUCT);
-	number_assign(multiplier, *num_a);
-	number_assign(num_s, NUM_0);
-	number_shift_left_once(&multiplier);
-
-	/* handle the first 'encryption_level' iterations */
-	for (seg = (u64*)&num_b->arr; seg < top; seg++) {
-		u64 mask;
-
-		for (mask = (u64)1; mask; mask = mask << 1) {
-			if (number_is_odd(&num_s))
-				number_add(&num_s, &num_s, num_n);
-			if (*seg & mask)
-				number_add(&num_s, &num_s, &multiplier);
-			number_shift_right_once(&num_s);
-		}
-	}
+	for (i = 0; i < 6; i++)
+		x = (u64)(x * (u64)(2 - (u64)(n0 * x)));
 
-	/* handle extra 2 iterations, as buffer size is is considered to be
-	 * MAX(bit_sz) + 2. */
-	for (i = 0 ;i < 3; i++) {
-		if (number_is_odd(&num_s))
-			number_add(&num_s, &num_s, num_n);
-		/* the two overflow bits of num_b are zero */
-		number_shift_right_once(&num_s);
-	}
+	return (u64)-x;
+}
+
+/* coarsely integrated operand scanning (CIOS) montgomery product:
+ * res = a * b * R^-1 mod n, where R = 2^(BIT_SZ_U64 * len)
+ * MonPro(a, b, n)
+ *   t = 0
+ *   for i = 0 to len-1 do
+ *     t = t + a*b(i)
+ *     m = t(0) * n0' mod 2^BIT_SZ_U64
+ *     t = (t + m*n) / 2^BIT_SZ_U64
+ *   end for
+ *   if t >= n then t = t - n
+ *   return t
+ * t is kept in len+2 limbs. for a < R and b < n (or vice versa) t < 2n before
+ * the final subtraction, so res < n. res may overlap a or b */
+static void ALWAYS_INLINE number_limbs_montgomery_product(u64 *res, u64 *a,
+	u64 *b, u64 *n, u64 n0_inv, int len)
+{
+	u64 t[RSA_NUMBER_ARRAY_SZ + 1];
+	int i, j;
+
+	memset(t, 0, (len + 2) * sizeof(u64));
+	for (i = 0; i < len; i++) {
+		u64 carry = 0, m;
+		u128 acc;
+
+		/* t = t + a*b(i) */
+#pragma GCC unroll 16
+		for (j = 0; j < len; j++) {
+			acc = (u128)a[j] * b[i] + t[j] + carry;
+			t[j] = (u64)acc;
+			carry = (u64)(acc >> BIT_SZ_U64);
+		}
+		acc = (u128)t[len] + carry;
+		t[len] = (u64)acc;
+		t[len + 1] = (u64)(acc >> BIT_SZ_U64);
+
+		/* t = (t + m*n) / 2^BIT_SZ_U64, the low limb of t + m*n is 0 */
+		m = (u64)(t[0] * n0_inv);
+		acc = (u128)m * n[0] + t[0];
+		carry = (u64)(acc >> BIT_SZ_U64);
+#pragma GCC unroll 16
+		for (j = 1; j < len; j++) {
+			acc = (u128)m * n[j] + t[j] + carry;
+			t[j - 1] = (u64)acc;
+			carry = (u64)(acc >> BIT_SZ_U64);
+		}
+		acc = (u128)t[len] + carry;
+		t[len - 1] = (u64)acc;
+		t[len] = t[len + 1] + (u64)(acc >> BIT_SZ_U64);
+	}
+
+	if (t[len] || number_limbs_cmp(t, n, len) >= 0)
+		number_limbs_sub(t, t, n, len);
+	memcpy(res, t, len * sizeof(u64));
+}
+
+/* montgomery reduction of a 2*len limb t, t < n*R:
+ * res = t * R^-1 mod n, where R = 2^(BIT_SZ_U64 * len)
+ *   for i = 0 to len-1 do
+ *     m = t(i) * n0' mod 2^BIT_SZ_U64
+ *     t = t + m*n*2^(BIT_SZ_U64*i) (zeroes t(i))
+ *   end for
+ *   t = t / R
+ *   if t >= n then t = t - n
+ * t must have 2*len+1 limbs, the most significant of which is 0. it is used as
+ * scratch */
+static void ALWAYS_INLINE number_limbs_montgomery_reduce(u64 *res, u64 *t,
+	u64 *n, u64 n0_inv, int len)
+{
+	int i, j;
+
+	for (i = 0; i < len; i++) {
+		u64 carry = 0, m = (u64)(t[i] * n0_inv);
+
+#pragma GCC unroll 16
+		for (j = 0; j < len; j++) {
+			u128 acc = (u128)m * n[j] + t[i + j] + carry;
+
+			t[i + j] = (u64)acc;
+			carry = (u64)(acc >> BIT_SZ_U64);
+		}
+		for (j = i + len; carry; j++)
+			carry = __builtin_add_overflow(t[j], carry, &t[j]);
+	}
+
+	t += len;
+	if (t[len] || number_limbs_cmp(t, n, len) >= 0)
+		number_limbs_sub(t, t, n, len);
+	memcpy(res, t, len * sizeof(u64));
+}
+
+/* montgomery squaring: res = a^2 * R^-1 mod n, where R = 2^(BIT_SZ_U64 * len)
+ * a^2 is computed before it is reduced, so each of the off diagonal products,
+ * a(i)*a(j) where i < j, is computed once and doubled. a must be smaller than
+ * n. res may overlap a */
+static void ALWAYS_INLINE number_limbs_montgomery_square(u64 *res, u64 *a,
+	u64 *n, u64 n0_inv, int len)
+{
+	u64 t[2 * RSA_NUMBER_ARRAY_SZ + 1], carry;
+	int i, j;
+
+	/* off diagonal products */
+	memset(t, 0, (2 * len + 1) * sizeof(u64));
+	for (i = 0; i < len - 1; i++) {
+		carry = 0;
+		if (!a[i])
+			continue;
+
+#pragma GCC unroll 16
+		for (j = i + 1; j < len; j++) {
+			u128 acc = (u128)a[i] * a[j] + t[i + j] + carry;
+
+			t[i + j] = (u64)acc;
+			carry = (u64)(acc >> BIT_SZ_U64);
+		}
+		t[i + len] = carry;
+	}
+
+	/* doubled, plus the diagonal */
+	number_limbs_shift_left(t, t, 2 * len, 1);
+	carry = 0;
+	for (i = 0; i < len; i++) {
+		u128 square = (u128)a[i] * a[i];
+		u128 acc = (u128)t[2 * i] + (u64)square + carry;
+
+		t[2 * i] = (u64)acc;
+		acc = (u128)t[2 * i + 1] + (u64)(square >> BIT_SZ_U64) +
+			(u64)(acc >> BIT_SZ_U64);
+		t[2 * i + 1] = (u64)acc;
+		carry = (u64)(acc >> BIT_SZ_U64);
+	}
+
+	number_limbs_montgomery_reduce(res, t, n, n0_inv, len);
+}
+
+/* instances of the limb kernels for len limbs. with a constant len the
+ * kernels' loops are unrolled, and their limbs may be kept in registers */
+#define NUMBER_KERNELS(NAME, LEN, BLOCK_SZ) \
+static u64 number_limbs_add_##NAME(u64 *res, u64 *a, u64 *b, int len) \
+{ \
+	return number_limbs_add(res, a, b, LEN); \
+} \
+static u64 number_limbs_sub_##NAME(u64 *res, u64 *a, u64 *b, int len) \
+{ \
+	return number_limbs_sub(res, a, b, LEN); \
+} \
+static void number_limbs_mul_##NAME(u64 *res, u64 *a, u64 *b, int len) \
+{ \
+	number_limbs_mul(res, LEN + 1, a, LEN, b, LEN); \
+} \
+static void number_limbs_montgomery_product_##NAME(u64 *res, u64 *a, \
+	u64 *b, u64 *n, u64 n0_inv, int len) \
+{ \
+	number_limbs_montgomery_product(res, a, b, n, n0_inv, LEN); \
+} \
+static void number_limbs_montgomery_square_##NAME(u64 *res, u64 *a, \
+	u64 *n, u64 n0_inv, int len) \
+{ \
+	number_limbs_montgomery_square(res, a, n, n0_inv, LEN); \
+} \
+static number_kernels_t number_kernels_##NAME = { \
+	.block_sz = BLOCK_SZ, \
+	.name = "portable", \
+	.add = number_limbs_add_##NAME, \
+	.sub = number_limbs_sub_##NAME, \
+	.mul = number_limbs_mul_##NAME, \
+	.montgomery_product = number_limbs_montgomery_product_##NAME, \
+	.montgomery_square = number_limbs_montgomery_square_##NAME, \
+}
+
+/* the block sizes of the 128, 256, 512 and 1024 bit levels, and any other.
+ * these are portable c */
+NUMBER_KERNELS(2, 2, 2);
+NUMBER_KERNELS(4, 4, 4);
+NUMBER_KERNELS(8, 8, 8);
+NUMBER_KERNELS(16, 16, 16);
+NUMBER_KERNELS(generic, len, 0);
+
+#if defined(ULLONG) && defined(__x86_64__)
+/* x86-64 kernels using the bmi2 mulx and adx adcx/adox instructions, for cpus
+ * which have them. mulx multiplies without touching the flags, so the low
+ * halves of a row of products are accumulated along the carry flag chain and
+ * the high halves along the overflow flag chain */
+#define NUMBER_KERNELS_MULX_ADX
+
+/* dst = src + a * b, where src and a are len limbs long, returns the limb
+ * carried out of dst. dst may be src, or one limb below it, in which case
+ * dst's low limb is overwritten by src's second one and so on.
+ * the assembly is volatile as the carry is not always used */
+#define MULX_ADX_STEP(K) \
+	"mulx " #K "*8(%[a]), %[lo], %[hi]\n\t" \
+	"adcx " #K "*8(%[src]), %[lo]\n\t" \
+	"adox %[carry], %[lo]\n\t" \
+	"mov %[lo], " #K "*8(%[dst])\n\t" \
+	"mov %[hi], %[carry]\n\t"
+#define MULX_ADX_CARRY_OUT \
+	"mov $0, %[lo]\n\t" \
+	"adcx %[lo], %[carry]\n\t" \
+	"adox %[lo], %[carry]"
+
+static u64 number_limbs_mul_add_mulx_adx(u64 *dst, u64 *src, u64 *a, u64 b,
+	int len)
+{
+	u64 lo, hi, carry = 0;
+	long i = -len;
+
+	/* i runs from -len to 0 in rcx, which jrcxz tests without touching
+	 * the flags */
+	__asm__ volatile (
+		"xor %[lo], %[lo]\n\t" /* clears CF and OF */
+		"1:\n\t"
+		"mulx (%[a],%[i],8), %[lo], %[hi]\n\t"
+		"adcx (%[src],%[i],8), %[lo]\n\t"
+		"adox %[carry], %[lo]\n\t"
+		"mov %[lo], (%[dst],%[i],8)\n\t"
+		"mov %[hi], %[carry]\n\t"
+		"lea 1(%[i]), %[i]\n\t"
+		"jrcxz 2f\n\t"
+		"jmp 1b\n"
+		"2:\n\t"
+		MULX_ADX_CARRY_OUT
+		: [i] "+c" (i), [carry] "+r" (carry), [lo] "=&r" (lo),
+		  [hi] "=&r" (hi)
+		: [a] "r" (a + len), [src] "r" (src + len),
+		  [dst] "r" (dst + len), "d" (b)
+		: "cc", "memory");
+	return carry;
+}
+
+/* number_limbs_mul_add_mulx_adx() of a fixed len, unrolled. len is unused */
+#define MULX_ADX_STEPS_2 MULX_ADX_STEP(0) MULX_ADX_STEP(1)
+#define MULX_ADX_STEPS_4 MULX_ADX_STEPS_2 MULX_ADX_STEP(2) MULX_ADX_STEP(3)
+#define MULX_ADX_STEPS_8 MULX_ADX_STEPS_4 MULX_ADX_STEP(4) MULX_ADX_STEP(5) \
+	MULX_ADX_STEP(6) MULX_ADX_STEP(7)
+#define MULX_ADX_STEPS_16 MULX_ADX_STEPS_8 MULX_ADX_STEP(8) MULX_ADX_STEP(9) \
+	MULX_ADX_STEP(10) MULX_ADX_STEP(11) MULX_ADX_STEP(12) \
+	MULX_ADX_STEP(13) MULX_ADX_STEP(14) MULX_ADX_STEP(15)
+#define NUMBER_LIMBS_MUL_ADD_MULX_ADX(LEN) \
+static u64 number_limbs_mul_add_mulx_adx_##LEN(u64 *dst, u64 *src, u64 *a, \
+	u64 b, int len) \
+{ \
+	u64 lo, hi, carry = 0; \
+\
+	__asm__ volatile ( \
+		"xor %[lo], %[lo]\n\t" \
+		MULX_ADX_STEPS_##LEN \
+		MULX_ADX_CARRY_OUT \
+		: [carry] "+r" (carry), [lo] "=&r" (lo), [hi] "=&r" (hi) \
+		: [a] "r" (a), [src] "r" (src), [dst] "r" (dst), "d" (b) \
+		: "cc", "memory"); \
+	return carry; \
+}
+
+NUMBER_LIMBS_MUL_ADD_MULX_ADX(2)
+NUMBER_LIMBS_MUL_ADD_MULX_ADX(4)
+NUMBER_LIMBS_MUL_ADD_MULX_ADX(8)
+NUMBER_LIMBS_MUL_ADD_MULX_ADX(16)
+
+typedef u64 (*mul_add_t)(u64 *dst, u64 *src, u64 *a, u64 b, int len);
+
+/* number_limbs_mul() of len limb operands, truncated to len + 1 limbs */
+static void number_limbs_mul_mulx_adx(u64 *res, u64 *a, u64 *b, int len)
+{
+	int i;
+
+	memset(res, 0, (len + 1) * sizeof(u64));
+	res[len] = number_limbs_mul_add_mulx_adx(res, res, a, b[0], len);
+	for (i = 1; i < len; i++) {
+		if (b[i]) {
+			number_limbs_mul_add_mulx_adx(res + i, res + i, a,
+				b[i], len + 1 - i);
+		}
+	}
+}
+
+/* number_limbs_montgomery_product(), whose rows are added by mul_add_len, of
+ * len limbs. t is kept one limb above the start of buf, so that t + m*n can
+ * be shifted down a limb as it is accumulated */
+static void ALWAYS_INLINE number_limbs_montgomery_product_mulx_adx(u64 *res,
+	u64 *a, u64 *b, u64 *n, u64 n0_inv, int len, mul_add_t mul_add_len)
+{
+	u64 buf[RSA_NUMBER_ARRAY_SZ + 2], *t = buf + 1, carry;
+	int i;
+
+	memset(t, 0, (len + 1) * sizeof(u64));
+	for (i = 0; i < len; i++) {
+		u64 t_top;
+
+		/* t = t + a*b(i) */
+		carry = mul_add_len(t, t, a, b[i], len);
+		t_top = __builtin_add_overflow(t[len], carry, &t[len]);
+
+		/* t = (t + m*n) / 2^BIT_SZ_U64 */
+		carry = mul_add_len(t - 1, t, n, (u64)(t[0] * n0_inv), len);
+		t_top += __builtin_add_overflow(t[len], carry, &t[len - 1]);
+		t[len] = t_top;
+	}
+
+	if (t[len] || number_limbs_cmp(t, n, len) >= 0)
+		number_limbs_sub(t, t, n, len);
+	memcpy(res, t, len * sizeof(u64));
+}
+
+/* number_limbs_montgomery_square(), whose reduction rows are added by
+ * mul_add_len */
+static void ALWAYS_INLINE number_limbs_montgomery_square_mulx_adx(u64 *res,
+	u64 *a, u64 *n, u64 n0_inv, int len, mul_add_t mul_add_len)
+{
+	u64 t[2 * RSA_NUMBER_ARRAY_SZ + 1], carry;
+	int i, j;
+
+	/* off diagonal products */
+	memset(t, 0, (2 * len + 1) * sizeof(u64));
+	for (i = 0; i < len - 1; i++) {
+		t[i + len] = number_limbs_mul_add_mulx_adx(t + 2 * i + 1,
+			t + 2 * i + 1, a + i + 1, a[i], len - i - 1);
+	}
+
+	/* doubled, plus the diagonal */
+	number_limbs_shift_left(t, t, 2 * len, 1);
+	carry = 0;
+	for (i = 0; i < len; i++) {
+		u128 square = (u128)a[i] * a[i];
+		u128 acc = (u128)t[2 * i] + (u64)square + carry;
+
+		t[2 * i] = (u64)acc;
+		acc = (u128)t[2 * i + 1] + (u64)(square >> BIT_SZ_U64) +
+			(u64)(acc >> BIT_SZ_U64);
+		t[2 * i + 1] = (u64)acc;
+		carry = (u64)(acc >> BIT_SZ_U64);
+	}
+
+	/* montgomery reduction */
+	for (i = 0; i < len; i++) {
+		carry = mul_add_len(t + i, t + i, n, (u64)(t[i] * n0_inv), len);
+		for (j = i + len; carry; j++)
+			carry = __builtin_add_overflow(t[j], carry, &t[j]);
+	}
+
+	if (t[2 * len] || number_limbs_cmp(t + len, n, len) >= 0)
+		number_limbs_sub(t + len, t + len, n, len);
+	memcpy(res, t + len, len * sizeof(u64));
+}
+
+#define NUMBER_KERNELS_MULX_ADX_SZ(NAME, LEN, BLOCK_SZ, MUL_ADD_LEN) \
+static void number_limbs_montgomery_product_mulx_adx_##NAME(u64 *res, \
+	u64 *a, u64 *b, u64 *n, u64 n0_inv, int len) \
+{ \
+	number_limbs_montgomery_product_mulx_adx(res, a, b, n, n0_inv, LEN, \
+		MUL_ADD_LEN); \
+} \
+static void number_limbs_montgomery_square_mulx_adx_##NAME(u64 *res, \
+	u64 *a, u64 *n, u64 n0_inv, int len) \
+{ \
+	number_limbs_montgomery_square_mulx_adx(res, a, n, n0_inv, LEN, \
+		MUL_ADD_LEN); \
+} \
+static number_kernels_t number_kernels_mulx_adx_##NAME = { \
+	.block_sz = BLOCK_SZ, \
+	.name = "mulx/adx", \
+	.add = number_limbs_add_##NAME, \
+	.sub = number_limbs_sub_##NAME, \
+	.mul = number_limbs_mul_mulx_adx, \
+	.montgomery_product = number_limbs_montgomery_product_mulx_adx_##NAME, \
+	.montgomery_square = number_limbs_montgomery_square_mulx_adx_##NAME, \
+}
 
-	number_assign(*num_res, num_s);
+NUMBER_KERNELS_MULX_ADX_SZ(2, 2, 2, number_limbs_mul_add_mulx_adx_2);
+NUMBER_KERNELS_MULX_ADX_SZ(4, 4, 4, number_limbs_mul_add_mulx_adx_4);
+NUMBER_KERNELS_MULX_ADX_SZ(8, 8, 8, number_limbs_mul_add_mulx_adx_8);
+NUMBER_KERNELS_MULX_ADX_SZ(16, 16, 16, number_limbs_mul_add_mulx_adx_16);
+NUMBER_KERNELS_MULX_ADX_SZ(generic, len, 0, number_limbs_mul_add_mulx_adx);
+
+static number_kernels_t *number_kernels_mulx_adx[] = {
+	&number_kernels_mulx_adx_2,
+	&number_kernels_mulx_adx_4,
+	&number_kernels_mulx_adx_8,
+	&number_kernels_mulx_adx_16,
+	&number_kernels_mulx_adx_generic,
+};
+#endif
+
+/* picked once per level by number_enclevl_set_r(). the mulx/adx kernels are
+ * picked if the cpu, as found by cpuid when the program is run, has them */
+static number_kernels_t *number_kernels[] = {
+	&number_kernels_2,
+	&number_kernels_4,
+	&number_kernels_8,
+	&number_kernels_16,
+	&number_kernels_generic,
+};
+
+static number_kernels_t *number_kernels_get(int block_sz)
+{
+	number_kernels_t **kernels = number_kernels;
+
+#ifdef NUMBER_KERNELS_MULX_ADX
+	if (__builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx"))
+		kernels = number_kernels_mulx_adx;
+#endif
+	for ( ; (*kernels)->block_sz && (*kernels)->block_sz != block_sz;
+		kernels++);
+	return *kernels;
+}
+
+/* montgomery product over the context set by
+ * number_montgomery_factor_set_r():
+ * num_res = num_a * num_b * R^-1 mod num_n, R = 2^level */
+static void INLINE number_montgomery_product_r(number_ctx_t *ctx,
+	u1024_t *num_res, u1024_t *num_a, u1024_t *num_b, u1024_t *num_n)
+{
+	TIMER_START(FUNC_NUMBER_MONTGOMERY_PRODUCT);
+	ctx->kernels->montgomery_product((u64*)&num_res->arr,
+		(u64*)&num_a->arr, (u64*)&num_b->arr, (u64*)&num_n->arr,
+		ctx->montgomery->n0_inv, ctx->block_sz);
+	*((u64*)&num_res->arr + ctx->block_sz) = 0;
+	number_top_set_r(ctx, num_res);
 	TIMER_STOP(FUNC_NUMBER_MONTGOMERY_PRODUCT);
 }
 
-/* shift left and do mod num_n 2*(encryption_level + 2) times... */
-void INLINE number_montgomery_factor_set(u1024_t *num_n, u1024_t *num_factor)
+/* num_res = num_a^2 * R^-1 mod num_n, num_a < num_n */
+static void INLINE number_montgomery_square_r(number_ctx_t *ctx,
+	u1024_t *num_res, u1024_t *num_a, u1024_t *num_n)
+{
+	TIMER_START(FUNC_NUMBER_MONTGOMERY_SQUARE);
+	ctx->kernels->montgomery_square((u64*)&num_res->arr,
+		(u64*)&num_a->arr, (u64*)&num_n->arr, ctx->montgomery->n0_inv,
+		ctx->block_sz);
+	*((u64*)&num_res->arr + ctx->block_sz) = 0;
+	number_top_set_r(ctx, num_res);
+	TIMER_STOP(FUNC_NUMBER_MONTGOMERY_SQUARE);
+}
+
+/* returns num_n's cached montgomery context at ctx's level. if there is none,
+ * the least recently used context is reset and returned, to be set by the
+ * caller. either way, the context becomes the most recently used */
+static montgomery_ctx_t *number_montgomery_ctx_lookup_r(number_ctx_t *ctx,
+	u1024_t *num_n)
+{
+	montgomery_ctx_t *mont;
+	int i;
+
+	if (!ctx->montgomery_lru[0]) {
+		for (i = 0; i < MONTGOMERY_CACHE_SZ; i++)
+			ctx->montgomery_lru[i] = &ctx->montgomery_cache[i];
+	}
+
+	for (i = 0; i < MONTGOMERY_CACHE_SZ; i++) {
+		mont = ctx->montgomery_lru[i];
+		if (mont->level == ctx->level &&
+			number_is_equal_r(ctx, &mont->n, num_n)) {
+			break;
+		}
+	}
+	if (i == MONTGOMERY_CACHE_SZ) {
+		mont = ctx->montgomery_lru[--i];
+		mont->level = 0;
+	}
+
+	memmove(ctx->montgomery_lru + 1, ctx->montgomery_lru,
+		i * sizeof(montgomery_ctx_t*));
+	ctx->montgomery_lru[0] = mont;
+	return mont;
+}
+
+/* sets the montgomery context of num_n at ctx's level.
+ * the montgomery factor, 2^(2*(level+2)) % num_n, is the one stored in the key
+ * files. if num_factor is NULL it is computed by a single long division of
+ * 2^(2*(level+2)), a 2*block_sz+1 limb number, by num_n.
+ * the montgomery product uses R = 2^level, whose R^2 % num_n is derived from
+ * the factor by four modular halvings */
+void INLINE number_montgomery_factor_set_r(number_ctx_t *ctx, u1024_t *num_n,
+	u1024_t *num_factor)
 {
+	montgomery_ctx_t *mont;
 	u1024_t factor;
-	int exp, exp_max;
-	u64 *buffer;
+	u64 power[2 * RSA_NUMBER_ARRAY_SZ], quotient[2 * RSA_NUMBER_ARRAY_SZ];
+	int exp, i;
 
 	TIMER_START(FUNC_NUMBER_MONTGOMERY_FACTOR_SET);
-	if (number_is_equal(&num_montgomery_n, num_n))
-		return;
+	mont = ctx->montgomery = number_montgomery_ctx_lookup_r(ctx, num_n);
+	if (mont->level)
+		goto Exit;
 
 	if (num_factor)
-		goto Exit;
+		goto Set;
 	num_factor = &factor;
 
-	exp_max = 2*(encryption_level+2);
-	number_small_dec2num(num_factor, (u64)1);
-	exp = 0;
-	buffer = (u64*)num_factor->arr + block_sz_u1024;
-
-	while (exp < exp_max) {
-		while (!*buffer && number_is_greater(num_n, num_factor)) {
-			if (exp == exp_max)
-				goto Exit;
-			number_shift_left_once(num_factor);
-			exp++;
-		}
-		number_sub(num_factor, num_factor, num_n);
+	exp = 2*(ctx->level+2);
+	memset(power, 0, (exp / BIT_SZ_U64 + 1) * sizeof(u64));
+	power[exp / BIT_SZ_U64] = (u64)1 << (exp % BIT_SZ_U64);
+	number_reset_r(ctx, num_factor);
+	number_limbs_dev(quotient, (u64*)&num_factor->arr, power,
+		exp / BIT_SZ_U64 + 1, (u64*)&num_n->arr, num_n->top + 1);
+	number_top_set_r(ctx, num_factor);
+
+Set:
+	mont->level = ctx->level;
+	number_assign_r(ctx, mont->factor, *num_factor);
+	number_assign_r(ctx, mont->n, *num_n);
+	mont->n0_inv = number_montgomery_n0_inv(*(u64*)&num_n->arr);
+
+	/* R^2 % n = factor * 2^-4 % n */
+	number_assign_r(ctx, mont->r2, mont->factor);
+	for (i = 0; i < 4; i++) {
+		if (number_is_odd(&mont->r2))
+			number_add_r(ctx, &mont->r2, &mont->r2, num_n);
+		number_shift_right_once(&mont->r2);
 	}
 
+	/* R % n, the n-residue of 1 */
+	number_montgomery_product_r(ctx, &mont->r, &mont->r2, &NUM_1, num_n);
+
 Exit:
-	number_assign(num_montgomery_factor, *num_factor);
-	number_assign(num_montgomery_n, *num_n);
-	number_montgomery_product(&num_res_nresidue, &num_montgomery_factor,
-		&NUM_1, num_n);
-	TIMER_START(FUNC_NUMBER_MONTGOMERY_FACTOR_SET);
+	TIMER_STOP(FUNC_NUMBER_MONTGOMERY_FACTOR_SET);
 }
 
-void INLINE number_montgomery_factor_get(u1024_t *num)
+void INLINE number_montgomery_factor_get_r(number_ctx_t *ctx, u1024_t *num)
 {
-	number_assign(*num, num_montgomery_factor);
+	number_assign_r(ctx, *num, ctx->montgomery->factor);
 }
 
-/* a: exponent
- * b: power
+/* a, b: multiplicands
  * n: modulus
- * r: 2^(encryption_level)%n
+ * r: 2^(level)%n
  * MonPro(a, b, n) = abr^-1%n
  *
- * a * b % n = abrr^-1%n = 1abrr^-1%n = MonPro(1, abr%n, n) =
- *             MonPro(1, arbrr^-1%n, n) = MonPro(1, ar%n*br%n*r^-1, n) =
- *             MonPro(1, a(r^2)(r^-1)%n * b(r^2)(r^-1) * (r^-1), n) =
- *             MonPro(1, MonPro(a(r^2)(r^-1)%n, b(r^2)(r^-1), n), n) =
- *             MonPro(1, MonPro(MonPro(a, r^2%n, n), MonPro(b, r^2%n, n), n), n)
+ * a * b % n = (ar%n)br^-1%n = MonPro(ar%n, b, n) =
+ *             MonPro(ar^2r^-1%n, b, n) = MonPro(MonPro(a, r^2%n, n), b, n)
  *
- * num_montgomery_factor = r^2%n = 2^2BIT_SZ(u1024_t)%n
+ * ctx->montgomery->r2 = r^2%n
  * a_tmp = MonPro(a, r^2%n, n)
- * b_tmp = MonPro(b, r^2%n, n)
- * a * b % n = MonPro(1, MonPro(a_tmp, b_tmp, n), n)
+ * a * b % n = MonPro(a_tmp, b, n)
+ *
+ * if a and b are the same number, and a < n, squaring is used:
+ * a * a % n = MonPro(MonPro(a, a, n), r^2%n, n)
  */
-STATIC int INLINE number_modular_multiplication_montgomery(u1024_t *num_res,
-	u1024_t *num_a, u1024_t *num_b, u1024_t *num_n)
+STATIC int INLINE number_modular_multiplication_montgomery_r(number_ctx_t *ctx,
+	u1024_t *num_res, u1024_t *num_a, u1024_t *num_b, u1024_t *num_n)
 {
 	int ret;
-	u1024_t a_tmp, b_tmp;
+	u1024_t a_tmp;
 
 	TIMER_START(FUNC_NUMBER_MODULAR_MULTIPLICATION_MONTGOMERY);
-	number_montgomery_factor_set(num_n, NULL);
+	number_montgomery_factor_set_r(ctx, num_n, NULL);
 
-	number_montgomery_product(&a_tmp, num_a, &num_montgomery_factor, num_n);
-	number_montgomery_product(&b_tmp, num_b, &num_montgomery_factor, num_n);
-	number_montgomery_product(num_res, &a_tmp, &b_tmp, num_n);
-	number_montgomery_product(num_res, &NUM_1, num_res, num_n);
+	if (num_a == num_b && number_is_greater(num_n, num_a)) {
+		number_montgomery_square_r(ctx, &a_tmp, num_a, num_n);
+		number_montgomery_product_r(ctx, num_res, &a_tmp,
+			&ctx->montgomery->r2, num_n);
+	}
+	else {
+		number_montgomery_product_r(ctx, &a_tmp, num_a,
+			&ctx->montgomery->r2, num_n);
+		number_montgomery_product_r(ctx, num_res, &a_tmp, num_b,
+			num_n);
+	}
 	ret = 0;
 
 	TIMER_STOP(FUNC_NUMBER_MODULAR_MULTIPLICATION_MONTGOMERY);
 	return ret;
 }
 
-/* montgomery (right-left, speed optimised) modular exponentiation procedure:
+/* window width for a sliding window exponentiation, by exponent bit length */
+static int INLINE number_exponent_window_sz(int bits)
+{
+	return bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4 : bits > 23 ? 3 :
+		1;
+}
+
+#define EXPONENT_BIT(E, I) ((*((u64*)&(E)->arr + (I) / BIT_SZ_U64) >> \
+	((I) % BIT_SZ_U64)) & (u64)1)
+#define EXPONENT_WINDOW_SZ_MAX 6
+#define EXPONENT_INTERLEAVE_MAX 4
+
+/* recodes b into sliding windows, scanning it from its most significant set
+ * bit, i:
+ *   while i >= 0 do
+ *     if (bi==0) then
+ *       one more square, i = i-1
+ *     else
+ *       find the longest window bi..bj, i-j+1 <= w, with bj==1
+ *       i-j+1 more squares, then a multiply by g[(bi..bj)/2], i = j-1
+ *     end if
+ *   end while
+ * the window width, w, is chosen by the bit length of b. squares before the
+ * first window, while r is still 1, are skipped */
+static void number_exponent_schedule_build_r(number_ctx_t *ctx,
+	exponent_schedule_t *schedule, u1024_t *b)
+{
+	int i, j, len, bits, squares = 0;
+	u64 *e = (u64*)&b->arr;
+
+	schedule->level = ctx->level;
+	number_assign_r(ctx, schedule->exp, *b);
+	schedule->window_sz = 1;
+	schedule->windows = 0;
+	schedule->squares_tail = 0;
+
+	for (len = ctx->block_sz; len && !e[len - 1]; len--);
+	if (!len)
+		return;
+	bits = (len - 1) * BIT_SZ_U64 + U64_MSB_IDX(e[len - 1]) + 1;
+	schedule->window_sz = number_exponent_window_sz(bits);
+
+	for (i = bits - 1; i >= 0; i = j - 1) {
+		int window = 0, k;
+
+		if (!EXPONENT_BIT(b, i)) {
+			squares++;
+			j = i;
+			continue;
+		}
+
+		j = i - schedule->window_sz + 1 < 0 ? 0 :
+			i - schedule->window_sz + 1;
+		while (!EXPONENT_BIT(b, j))
+			j++;
+		for (k = i; k >= j; k--)
+			window = window << 1 | (int)EXPONENT_BIT(b, k);
+
+		schedule->squares[schedule->windows] = schedule->windows ?
+			squares + i - j + 1 : 0;
+		schedule->window[schedule->windows++] = window >> 1;
+		squares = 0;
+	}
+	schedule->squares_tail = squares;
+}
+
+/* the schedule of b: the context's, if it was set to b at its level, or else
+ * one recoded into schedule */
+static exponent_schedule_t *number_exponent_schedule_get_r(number_ctx_t *ctx,
+	exponent_schedule_t *schedule, u1024_t *b)
+{
+	if (ctx->exponent_schedule.level == ctx->level &&
+		number_is_equal_r(ctx, &ctx->exponent_schedule.exp, b)) {
+		return &ctx->exponent_schedule;
+	}
+
+	number_exponent_schedule_build_r(ctx, schedule, b);
+	return schedule;
+}
+
+/* recodes exp once, for the exponentiations by it to replay, as with the
+ * blocks of a file encoded by a key */
+void number_exponent_schedule_set_r(number_ctx_t *ctx, u1024_t *exp)
+{
+	number_exponent_schedule_build_r(ctx, &ctx->exponent_schedule, exp);
+}
+
+/* montgomery (left-right, sliding window) modular exponentiation procedure:
  * MonExp(a, b, n)
  *   c = 2^(2n)
  *   A = MonPro(c, a, n) (mapping)
+ *   g[i] = A^(2i+1), for 0 <= 2i+1 < 2^w (odd powers of A)
  *   r = MonPro(c, 1, n)
- *   for i = 0 to k-1 do
- *     if (bi==1) then
- *       r = MonPro(r, a, n) (multiply)
- *     end if
- *     A = MonPro(A, A, n) (square)
+ *   for each window k of b's schedule
+ *     r = r^(2^squares[k]) (square squares[k] times)
+ *     r = MonPro(r, g[window[k]], n) (multiply)
  *   end for
+ *   r = r^(2^squares_tail)
  *   r = MonPro(1, r, n)
  *   return r
+ * the schedule, see number_exponent_schedule_build_r(), is replayed without
+ * scanning b. the first window is assigned, r being 1.
+ * count blocks, up to EXPONENT_INTERLEAVE_MAX, are exponentiated together:
+ * each step is taken for all the blocks in turn. the blocks' products are
+ * independent of each other, so the cpu can overlap them rather than wait on
+ * a single block's carry chains.
+ * r is left as the n-residue of a^b, without the final MonPro(1, r, n), for
+ * callers that keep on working in the montgomery domain
  */
-int INLINE number_modular_exponentiation_montgomery(u1024_t *res, u1024_t *a,
-	u1024_t *b, u1024_t *n)
+static void INLINE number_montgomery_power_r(number_ctx_t *ctx, u1024_t *r,
+	u1024_t *a, int count, u1024_t *b, u1024_t *n)
 {
-	u1024_t a_nresidue;
-	u64 *seg;
-	int ret = 0;
-
-	TIMER_START(FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY);
-	number_montgomery_factor_set(n, NULL);
-	number_montgomery_product(&a_nresidue, &num_montgomery_factor, a, n);
-	number_assign(*res, num_res_nresidue);
+	u1024_t g[1 << (EXPONENT_WINDOW_SZ_MAX - 1)][EXPONENT_INTERLEAVE_MAX];
+	u1024_t a_squared;
+	exponent_schedule_t schedule_tmp, *schedule;
+	int i, k, l;
+
+	schedule = number_exponent_schedule_get_r(ctx, &schedule_tmp, b);
+	for (l = 0; l < count; l++)
+		number_assign_r(ctx, r[l], ctx->montgomery->r);
+	if (!schedule->windows)
+		return;
 
-	for (seg = (u64*)&b->arr; seg < (u64*)&b->arr + block_sz_u1024; seg++) {
-		u64 mask;
+	/* precompute the odd powers of a's n-residue */
+	for (l = 0; l < count; l++) {
+		number_montgomery_product_r(ctx, &g[0][l],
+			&ctx->montgomery->r2, &a[l], n);
+		if (schedule->window_sz == 1)
+			continue;
+		number_montgomery_square_r(ctx, &a_squared, &g[0][l], n);
+		for (i = 1; i < 1 << (schedule->window_sz - 1); i++) {
+			number_montgomery_product_r(ctx, &g[i][l],
+				&g[i - 1][l], &a_squared, n);
+		}
+	}
 
-		for (mask = (u64)1; mask; mask = mask << 1) {
-			if (*seg & mask) {
-				number_montgomery_product(res, res, &a_nresidue,
- 					n);
+	for (l = 0; l < count; l++)
+		number_assign_r(ctx, r[l], g[schedule->window[0]][l]);
+	for (k = 1; k < schedule->windows; k++) {
+		for (i = 0; i < schedule->squares[k]; i++) {
+			for (l = 0; l < count; l++) {
+				number_montgomery_square_r(ctx, &r[l], &r[l],
+					n);
 			}
-			number_montgomery_product(&a_nresidue, &a_nresidue,
-				&a_nresidue, n);
+		}
+		for (l = 0; l < count; l++) {
+			number_montgomery_product_r(ctx, &r[l], &r[l],
+				&g[schedule->window[k]][l], n);
 		}
 	}
-	number_montgomery_product(res, &NUM_1, res, n);
+	for (i = 0; i < schedule->squares_tail; i++) {
+		for (l = 0; l < count; l++)
+			number_montgomery_square_r(ctx, &r[l], &r[l], n);
+	}
+}
+
+static void INLINE number_montgomery_exponentiation_r(number_ctx_t *ctx,
+	u1024_t *res, u1024_t *a, int count, u1024_t *b, u1024_t *n)
+{
+	u1024_t r[EXPONENT_INTERLEAVE_MAX];
+	int l;
 
+	number_montgomery_power_r(ctx, r, a, count, b, n);
+	for (l = 0; l < count; l++)
+		number_montgomery_product_r(ctx, &res[l], &NUM_1, &r[l], n);
+}
+
+int INLINE number_modular_exponentiation_montgomery_r(number_ctx_t *ctx,
+	u1024_t *res, u1024_t *a, u1024_t *b, u1024_t *n)
+{
+	TIMER_START(FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY);
+	number_montgomery_factor_set_r(ctx, n, NULL);
+	number_montgomery_exponentiation_r(ctx, res, a, 1, b, n);
 	TIMER_STOP(FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY);
-	return ret;
+	return 0;
 }
 
-static void INLINE number_witness_init(u1024_t *num_n_min1, u1024_t *num_u,
-	int *t)
+/* batch montgomery exponentiation: blocks sharing an exponent and a modulus
+ * are exponentiated at once, one block per vector lane.
+ * a batch number is kept in len limbs of radix bits, each limb holding the
+ * blocks' limbs in consecutive lanes (structure of arrays). the montgomery
+ * products use R = 2^(radix*len), 4n < R, and are almost montgomery products:
+ * they are not reduced below n but kept below 2n, which a final product by 1
+ * brings to at most n. so the exponentiation, uniform for all lanes, has no
+ * data dependant branches */
+#if defined(ULLONG) && defined(__x86_64__)
+#define NUMBER_BATCH_SIMD
+
+/* limbs of a batch number, radix 52 bits by 8 lanes at the 1024 bit level */
+#define NUMBER_BATCH_LIMBS_MAX 20
+#define NUMBER_BATCH_SZ_MAX 160
+
+/* avx-512 ifma: 8 lanes of 52 bit limbs. vpmadd52luq and vpmadd52huq add the
+ * low and high 52 bits of a 52 by 52 bit product to a 64 bit accumulator. t(j)
+ * gains at most 4 such halves per round, so over len <= 20 rounds it stays
+ * below 2^59 and limbs need to be normalised only once, at the end */
+static void __attribute__((target("avx512f,avx512ifma")))
+number_batch_montgomery_product_ifma(u64 *res, u64 *a, u64 *b, u64 *n,
+	u64 n0_inv, int len)
 {
-	u1024_t tmp;
+	__m512i t[NUMBER_BATCH_LIMBS_MAX + 1], nv[NUMBER_BATCH_LIMBS_MAX];
+	__m512i mask = _mm512_set1_epi64(((u64)1 << 52) - 1);
+	__m512i zero = _mm512_setzero_si512();
+	__m512i n0v = _mm512_set1_epi64(n0_inv), carry;
+	int i, j;
+
+	for (j = 0; j < len; j++) {
+		nv[j] = _mm512_set1_epi64(n[j]);
+		t[j] = zero;
+	}
+	t[len] = zero;
 
-	TIMER_START(FUNC_NUMBER_WITNESS_INIT);
-	number_assign(tmp, *num_n_min1);
-	*t = 0;
-	while (!number_is_odd(&tmp)) {
-		number_shift_right_once(&tmp);
-		(*t)++;
+	for (i = 0; i < len; i++) {
+		__m512i bi = _mm512_loadu_si512(b + 8 * i), m;
+
+		/* t = t + a*b(i) */
+		for (j = 0; j < len; j++) {
+			__m512i aj = _mm512_loadu_si512(a + 8 * j);
+
+			t[j] = _mm512_madd52lo_epu64(t[j], aj, bi);
+			t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], aj, bi);
+		}
+
+		/* t = (t + m*n) / 2^52, the low 52 bits of t + m*n are 0 */
+		m = _mm512_madd52lo_epu64(zero, t[0], n0v);
+		for (j = 0; j < len; j++) {
+			t[j] = _mm512_madd52lo_epu64(t[j], m, nv[j]);
+			t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], m, nv[j]);
+		}
+		carry = _mm512_srli_epi64(t[0], 52);
+		t[0] = _mm512_add_epi64(t[1], carry);
+		for (j = 1; j < len; j++)
+			t[j] = t[j + 1];
+		t[len] = zero;
 	}
 
-	number_assign(*num_u, tmp);
-	TIMER_STOP(FUNC_NUMBER_WITNESS_INIT);
+	carry = zero;
+	for (j = 0; j < len; j++) {
+		t[j] = _mm512_add_epi64(t[j], carry);
+		carry = _mm512_srli_epi64(t[j], 52);
+		_mm512_storeu_si512(res + 8 * j, _mm512_and_si512(t[j], mask));
+	}
 }
 
-/* witness method used by the miller-rabin algorithm. attempt to use num_a as a
- * witness of num_n's compositeness:
- * if number_witness(num_a, num_n) is true, then num_n is composite
- */
-STATIC int INLINE number_witness(u1024_t *num_a, u1024_t *num_n)
+static int number_batch_is_supported_ifma(void)
+{
+	return __builtin_cpu_supports("avx512f") &&
+		__builtin_cpu_supports("avx512ifma");
+}
+
+static number_batch_t number_batch_ifma = {
+	.name = "avx-512 ifma",
+	.lanes = 8,
+	.radix = 52,
+	.is_supported = number_batch_is_supported_ifma,
+	.montgomery_product = number_batch_montgomery_product_ifma,
+};
+
+#endif
+
+/* blocks are exponentiated by the scalar kernels, a few of them interleaved */
+static number_batch_t number_batch_scalar = {
+	.name = "scalar",
+	.lanes = 1,
+};
+
+/* the engines, in order of preference. the first one the cpu supports is
+ * picked */
+static number_batch_t *number_batches[] = {
+#ifdef NUMBER_BATCH_SIMD
+	&number_batch_ifma,
+#endif
+	&number_batch_scalar,
+};
+
+static number_batch_t *number_batch_get(void)
 {
-	u1024_t num_u, num_x_prev, num_x_curr, num_n_min1;
-	int i, t, ret;
+	number_batch_t **batch;
 
-	TIMER_START(FUNC_NUMBER_WITNESS);
-	if (!number_is_odd(num_n)) {
-		ret = 1;
-		goto Exit;
+	for (batch = number_batches; (*batch)->is_supported &&
+		!(*batch)->is_supported(); batch++);
+	return *batch;
+}
+
+#ifdef NUMBER_BATCH_SIMD
+/* lane of x = num, a block_sz limb number, in len limbs of radix bits */
+static void number_batch_split(u64 *x, int lanes, u64 *num, int block_sz,
+	int radix, int len)
+{
+	u64 mask = ((u64)1 << radix) - 1;
+	int j;
+
+	for (j = 0; j < len; j++) {
+		int limb = j * radix / BIT_SZ_U64;
+		int shift = j * radix % BIT_SZ_U64;
+		u64 limb_radix = limb < block_sz ? num[limb] >> shift : 0;
+
+		if (shift + radix > BIT_SZ_U64 && limb + 1 < block_sz)
+			limb_radix |= num[limb + 1] << (BIT_SZ_U64 - shift);
+		x[j * lanes] = limb_radix & mask;
 	}
+}
 
-	number_sub(&num_n_min1, num_n, &NUM_1);
-	number_witness_init(&num_n_min1, &num_u, &t);
-	if (number_modular_exponentiation_montgomery(&num_x_prev, num_a, &num_u,
-		num_n)) {
-		ret = 1;
-		goto Exit;
+/* num, a block_sz limb number, = lane of x, in len limbs of radix bits */
+static void number_batch_join(u64 *num, int block_sz, u64 *x, int lanes,
+	int radix, int len)
+{
+	int j;
+
+	memset(num, 0, block_sz * sizeof(u64));
+	for (j = 0; j < len; j++) {
+		int limb = j * radix / BIT_SZ_U64;
+		int shift = j * radix % BIT_SZ_U64;
+		u64 limb_radix = x[j * lanes];
+
+		if (limb < block_sz)
+			num[limb] |= limb_radix << shift;
+		if (shift + radix > BIT_SZ_U64 && limb + 1 < block_sz)
+			num[limb + 1] |= limb_radix >> (BIT_SZ_U64 - shift);
 	}
+}
 
-	for (i = 0; i < t; i++) {
-		if (number_modular_multiplication_montgomery(&num_x_curr,
-			&num_x_prev, &num_x_prev, num_n)) {
-			ret = 1;
-			goto Exit;
+/* res(k) = a(k)^b % n, for up to batch->lanes blocks, over the montgomery
+ * context of n. the sliding window of the scalar exponentiation is shared by
+ * all lanes */
+static void number_batch_exponentiation_r(number_ctx_t *ctx,
+	number_batch_t *batch, u1024_t *res, u1024_t *a, int count,
+	u1024_t *b, u1024_t *n)
+{
+	u64 g[1 << (EXPONENT_WINDOW_SZ_MAX - 1)][NUMBER_BATCH_SZ_MAX];
+	u64 x[NUMBER_BATCH_SZ_MAX], a_squared[NUMBER_BATCH_SZ_MAX];
+	u64 one[NUMBER_BATCH_SZ_MAX], r2[NUMBER_BATCH_SZ_MAX];
+	u64 n_radix[NUMBER_BATCH_LIMBS_MAX], n0_inv;
+	u64 power[2 * RSA_NUMBER_ARRAY_SZ], quotient[2 * RSA_NUMBER_ARRAY_SZ];
+	u64 remainder[RSA_NUMBER_ARRAY_SZ];
+	int lanes = batch->lanes, radix = batch->radix;
+	int len = (ctx->level + 2 + radix - 1) / radix, size = len * lanes;
+	int exp = 2 * radix * len, i, k;
+	exponent_schedule_t schedule_tmp, *schedule;
+
+	/* R^2 % n, R = 2^(radix*len), in every lane */
+	memset(power, 0, (exp / BIT_SZ_U64 + 1) * sizeof(u64));
+	power[exp / BIT_SZ_U64] = (u64)1 << (exp % BIT_SZ_U64);
+	number_limbs_dev(quotient, remainder, power, exp / BIT_SZ_U64 + 1,
+		(u64*)&n->arr, n->top + 1);
+	memset(remainder + n->top + 1, 0,
+		(ctx->block_sz - n->top - 1) * sizeof(u64));
+	number_batch_split(n_radix, 1, (u64*)&n->arr, ctx->block_sz, radix,
+		len);
+	n0_inv = ctx->montgomery->n0_inv & (((u64)1 << radix) - 1);
+	memset(one, 0, size * sizeof(u64));
+	for (k = 0; k < lanes; k++) {
+		number_batch_split(r2 + k, lanes, remainder, ctx->block_sz,
+			radix, len);
+		number_batch_split(x + k, lanes, (u64*)&a[k < count ? k :
+			0].arr, ctx->block_sz, radix, len);
+		one[k] = 1;
+	}
+
+	/* precompute the odd powers of a's n-residues */
+	schedule = number_exponent_schedule_get_r(ctx, &schedule_tmp, b);
+	batch->montgomery_product(g[0], x, r2, n_radix, n0_inv, len);
+	if (schedule->window_sz > 1) {
+		batch->montgomery_product(a_squared, g[0], g[0], n_radix,
+			n0_inv, len);
+		for (i = 1; i < 1 << (schedule->window_sz - 1); i++) {
+			batch->montgomery_product(g[i], g[i - 1], a_squared,
+				n_radix, n0_inv, len);
 		}
-		if (number_is_equal(&num_x_curr, &NUM_1) &&
-			!number_is_equal(&num_x_prev, &NUM_1) &&
-			!number_is_equal(&num_x_prev, &num_n_min1)){
-			ret = 1;
-			goto Exit;
+	}
+
+	/* x = g[window[0]], or R % n, the n-residue of 1, if b = 0 */
+	if (schedule->windows)
+		memcpy(x, g[schedule->window[0]], size * sizeof(u64));
+	else
+		batch->montgomery_product(x, r2, one, n_radix, n0_inv, len);
+	for (k = 1; k < schedule->windows; k++) {
+		for (i = 0; i < schedule->squares[k]; i++) {
+			batch->montgomery_product(x, x, x, n_radix, n0_inv,
+				len);
 		}
-		number_assign(num_x_prev, num_x_curr);
+		batch->montgomery_product(x, x, g[schedule->window[k]],
+			n_radix, n0_inv, len);
+	}
+	for (i = 0; i < schedule->squares_tail; i++)
+		batch->montgomery_product(x, x, x, n_radix, n0_inv, len);
+
+	/* out of the montgomery domain, x <= n */
+	batch->montgomery_product(x, x, one, n_radix, n0_inv, len);
+	for (k = 0; k < count; k++) {
+		number_reset_r(ctx, &res[k]);
+		number_batch_join((u64*)&res[k].arr, ctx->block_sz, x + k,
+			lanes, radix, len);
+		number_top_set_r(ctx, &res[k]);
+		if (number_is_greater_or_equal(&res[k], n))
+			number_sub_r(ctx, &res[k], &res[k], n);
+	}
+}
+#endif
+
+/* res(k) = a(k)^b % n, for count blocks, k < count. res may be a.
+ * the blocks are exponentiated by the context's batch engine, lanes at a time,
+ * or interleaved by the scalar kernels, with the results of
+ * number_modular_exponentiation_montgomery_r() */
+int number_modular_exponentiation_montgomery_batch_r(number_ctx_t *ctx,
+	u1024_t *res, u1024_t *a, int count, u1024_t *b, u1024_t *n)
+{
+	int k;
+#ifdef NUMBER_BATCH_SIMD
+	number_batch_t *batch = ctx->batch;
+#endif
+
+	TIMER_START(FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY_BATCH);
+	number_montgomery_factor_set_r(ctx, n, NULL);
+	k = 0;
+#ifdef NUMBER_BATCH_SIMD
+	/* a last single block is left to the scalar exponentiation */
+	for ( ; batch->lanes > 1 && k + 1 < count; k += batch->lanes) {
+		number_batch_exponentiation_r(ctx, batch, res + k, a + k,
+			count - k < batch->lanes ? count - k : batch->lanes, b,
+			n);
+	}
+#endif
+	for ( ; k < count; k += EXPONENT_INTERLEAVE_MAX) {
+		number_montgomery_exponentiation_r(ctx, res + k, a + k,
+			count - k < EXPONENT_INTERLEAVE_MAX ? count - k :
+			EXPONENT_INTERLEAVE_MAX, b, n);
+	}
+	TIMER_STOP(FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY_BATCH);
+	return 0;
+}
+
+/* res = a + b modulo m, for a, b < m */
+static void ALWAYS_INLINE number_limbs_add_mod(u64 *res, u64 *a, u64 *b,
+	u64 *m, int len)
+{
+	if (number_limbs_add(res, a, b, len) ||
+		number_limbs_cmp(res, m, len) >= 0) {
+		number_limbs_sub(res, res, m, len);
+	}
+}
+
+/* res = a - b modulo m, for a, b < m */
+static void ALWAYS_INLINE number_limbs_sub_mod(u64 *res, u64 *a, u64 *b,
+	u64 *m, int len)
+{
+	if (number_limbs_sub(res, a, b, len))
+		number_limbs_add(res, res, m, len);
+}
+
+/* a = a / 2^k modulo the odd m, for a < m and 0 < k < BIT_SZ_U64.
+ * with m_inv = -m^-1 mod 2^BIT_SZ_U64, a + t*m, for t = a * m_inv mod 2^k, is
+ * divisible by 2^k, and less than 2^k * m */
+static void ALWAYS_INLINE number_limbs_shift_right_mod(u64 *a, u64 *m,
+	u64 m_inv, int k, int len)
+{
+	u64 t = (u64)(a[0] * m_inv) & (u64)(((u64)1 << k) - 1);
+	u64 carry = number_limbs_mul_add(a, a, m, t, len);
+
+	number_limbs_shift_right(a, a, len, k);
+	a[len - 1] |= (u64)(carry << (BIT_SZ_U64 - k));
+}
+
+/* the decomposition n - 1 = 2^t * u of an odd n, shared by the miller-rabin
+ * rounds on n, and the n-residues of 1 and n - 1 their squares are compared
+ * against */
+typedef struct {
+	u1024_t n_min1;
+	u1024_t u;
+	u1024_t one; /* R % n */
+	u1024_t min1; /* (n - 1) * R % n = n - R % n */
+	int t;
+} number_witness_t;
+
+static void INLINE number_witness_init_r(number_ctx_t *ctx,
+	number_witness_t *witness, u1024_t *num_n)
+{
+	TIMER_START(FUNC_NUMBER_WITNESS_INIT);
+	number_montgomery_factor_set_r(ctx, num_n, NULL);
+	number_sub_r(ctx, &witness->n_min1, num_n, &NUM_1);
+	witness->t = number_trailing_zeros(&witness->n_min1);
+	number_assign_r(ctx, witness->u, witness->n_min1);
+	number_shift_right_r(ctx, &witness->u, witness->t);
+
+	number_assign_r(ctx, witness->one, ctx->montgomery->r);
+	number_sub_r(ctx, &witness->min1, num_n, &witness->one);
+	TIMER_STOP(FUNC_NUMBER_WITNESS_INIT);
+}
+
+/* the strong probable prime test of n to the base a, given num_x, the
+ * n-residue of a^u: n passes if a^u == 1 or a^(2^i * u) == n - 1 for some
+ * 0 <= i < t. the squares stay in the montgomery domain, a single montgomery
+ * square each, and are compared against the n-residues of 1 and n - 1.
+ * returns 1 if a is a witness of n's compositeness */
+static int INLINE number_witness_strong_r(number_ctx_t *ctx,
+	number_witness_t *witness, u1024_t *num_x, u1024_t *num_n)
+{
+	int i;
+
+	if (number_is_equal_r(ctx, num_x, &witness->one) ||
+		number_is_equal_r(ctx, num_x, &witness->min1)) {
+		return 0;
+	}
+
+	for (i = 1; i < witness->t; i++) {
+		number_montgomery_square_r(ctx, num_x, num_x, num_n);
+		if (number_is_equal_r(ctx, num_x, &witness->min1))
+			return 0;
+		/* a non trivial square root of 1 */
+		if (number_is_equal_r(ctx, num_x, &witness->one))
+			return 1;
+	}
+	return 1;
+}
+
+/* num_x = the n-residue of 2^u, from u's most significant bit: a square, and
+ * for a set bit a doubling, which for an n-residue is a modular addition. so
+ * the base 2 test takes neither multiplications nor a table of powers */
+static void INLINE number_montgomery_power2_r(number_ctx_t *ctx,
+	u1024_t *num_x, u1024_t *num_u, u1024_t *num_n)
+{
+	u64 *x = (u64*)&num_x->arr, *n = (u64*)&num_n->arr;
+	int i, bits = number_bit_len(num_u);
+
+	number_assign_r(ctx, *num_x, ctx->montgomery->r);
+	for (i = bits - 1; i >= 0; i--) {
+		if (i != bits - 1)
+			number_montgomery_square_r(ctx, num_x, num_x, num_n);
+		if (EXPONENT_BIT(num_u, i))
+			number_limbs_add_mod(x, x, x, n, ctx->block_sz);
 	}
+	number_top_set_r(ctx, num_x);
+}
+
+/* witness method used by the miller-rabin algorithm. attempt to use num_a as a
+ * witness of num_n's compositeness:
+ * if number_witness_r(ctx, num_a, num_n) is true, then num_n is composite
+ */
+STATIC int INLINE number_witness_r(number_ctx_t *ctx, u1024_t *num_a,
+	u1024_t *num_n)
+{
+	number_witness_t witness;
+	u1024_t num_x;
+	int ret;
 
-	if (!number_is_equal(&num_x_curr, &NUM_1)) {
+	TIMER_START(FUNC_NUMBER_WITNESS);
+	if (!number_is_odd(num_n)) {
 		ret = 1;
 		goto Exit;
 	}
-	ret = 0;
+
+	number_witness_init_r(ctx, &witness, num_n);
+	number_montgomery_power_r(ctx, &num_x, num_a, 1, &witness.u, num_n);
+	ret = number_witness_strong_r(ctx, &witness, &num_x, num_n);
 
 Exit:
 	TIMER_STOP(FUNC_NUMBER_WITNESS);
@@ -659,26 +2058,39 @@ Exit:
 }
 
 /* miller-rabin algorithm
- * num_n is an odd integer greater than 2
+ * num_n is an odd integer greater than 2, and witness its decomposition.
+ * rounds random bases are tried, EXPONENT_INTERLEAVE_MAX of them exponentiated
+ * together, as they mostly run on primes, which take all the rounds
  * return:
  * 0 - if num_n is composite
  * 1 - if num_n is almost surely prime
  */
-STATIC int INLINE number_miller_rabin(u1024_t *num_n, u1024_t *num_s)
+STATIC int INLINE number_miller_rabin_r(number_ctx_t *ctx, u1024_t *num_n,
+	number_witness_t *witness, int rounds)
 {
-	int ret;
-	u1024_t num_j, num_a;
+	u1024_t num_a[EXPONENT_INTERLEAVE_MAX], num_x[EXPONENT_INTERLEAVE_MAX];
+	barrett_ctx_t range_min1;
+	int i, j, count, ret;
 
 	TIMER_START(FUNC_NUMBER_MILLER_RABIN);
-	number_assign(num_j, NUM_1);
-
-	while (!number_is_equal(&num_j, num_s)) {
-		number_init_random_strict_range(&num_a, num_n);
-		if (number_witness(&num_a, num_n)) {
-			ret = 0;
-			goto Exit;
+	number_strict_range_set_r(ctx, &range_min1, num_n);
+
+	for (i = 0; i < rounds; i += count) {
+		count = rounds - i < EXPONENT_INTERLEAVE_MAX ? rounds - i :
+			EXPONENT_INTERLEAVE_MAX;
+		for (j = 0; j < count; j++) {
+			number_init_random_strict_range_r(ctx, &num_a[j],
+				&range_min1);
+		}
+		number_montgomery_power_r(ctx, num_x, num_a, count,
+			&witness->u, num_n);
+		for (j = 0; j < count; j++) {
+			if (number_witness_strong_r(ctx, witness, &num_x[j],
+				num_n)) {
+				ret = 0;
+				goto Exit;
+			}
 		}
-		number_add(&num_j, &num_j, &NUM_1);
 	}
 	ret = 1;
 
@@ -687,42 +2099,257 @@ Exit:
 	return ret;
 }
 
-STATIC int INLINE number_is_prime(u1024_t *num_n)
+/* random base miller-rabin rounds confirming a base 2 strong probable prime of
+ * the given bit length, k. the base 2 test is counted as the first of the t
+ * rounds of the damgard-landrock-pomerance bound on the error probability of
+ * a random k bit candidate, p(k, t), and t is the least for which p(k, t) is
+ * below 2^-s, s being the security strength of a 2k bit rsa modulus: the
+ * number field sieve's work, calibrated to 80 bits at 1024 (SP 800-57), which
+ * is about 27 bits at 128, 40 at 256, 57 at 512 and 110 at 2048. candidates
+ * of up to 80 bits are given 8, the bound of the 9 random base rounds run
+ * before the base 2 test. number_is_prime_r() confirms those of up to 64 bits
+ * by the strong lucas test instead, which it takes no error bound for */
+static int INLINE number_miller_rabin_rounds(int bits)
 {
-	int ret;
-	u1024_t num_s;
-
-	TIMER_START(FUNC_NUMBER_IS_PRIME);
-	number_assign(num_s, NUM_10);
-	ret = number_miller_rabin(num_n, &num_s);
-
-	TIMER_STOP(FUNC_NUMBER_IS_PRIME);
-	return ret;
+	return bits > 1372 ? 3 : bits > 518 ? 4 : bits > 240 ? 5 :
+		bits > 130 ? 6 : bits > 80 ? 7 : 8;
 }
 
-/* initiate number_generate_coprime:small_primes[] fields and generate pi and
- * incrementor
+/* the jacobi symbol (a/n), for an odd n */
+static int number_jacobi_small(u64 a, u64 n)
+{
+	int j = 1;
+	u64 t;
+
+	for (a %= n; a; a %= n) {
+		for ( ; !(a & 1); a >>= 1) {
+			if ((n & 7) == 3 || (n & 7) == 5)
+				j = -j;
+		}
+		/* reciprocity */
+		if ((a & 3) == 3 && (n & 3) == 3)
+			j = -j;
+		t = a;
+		a = n;
+		n = t;
+	}
+	return n == 1 ? j : 0;
+}
+
+/* the jacobi symbol (d/n), for an odd n and a small odd d, by reciprocity:
+ * (|d|/n) = ((n % |d|)/|d|), negated if both |d| and n are 3 mod 4, and
+ * (-1/n) = -1 if n is 3 mod 4 */
+static int INLINE number_jacobi_r(number_ctx_t *ctx, int d, u1024_t *num_n)
+{
+	u64 abs_d = (u64)(d < 0 ? -d : d), n_mod4 = *(u64*)&num_n->arr & 3;
+	int j;
+
+	j = number_jacobi_small(number_mod_small_r(ctx, num_n, abs_d), abs_d);
+	if ((abs_d & 3) == 3 && n_mod4 == 3)
+		j = -j;
+	if (d < 0 && n_mod4 == 3)
+		j = -j;
+	return j;
+}
+
+/* is num_n a square: s = isqrt(n) by newton's iteration, from
+ * 2^ceil(bits / 2) >= isqrt(n) down */
+static int number_is_square_r(number_ctx_t *ctx, u1024_t *num_n)
+{
+	u1024_t num_s, num_t, num_q, num_r;
+
+	number_small_dec2num_r(ctx, &num_s, (u64)1);
+	number_shift_left_r(ctx, &num_s, (number_bit_len(num_n) + 1) / 2);
+	while (1) {
+		number_dev_r(ctx, &num_q, &num_r, num_n, &num_s);
+		number_add_r(ctx, &num_t, &num_s, &num_q);
+		number_shift_right_r(ctx, &num_t, 1);
+		if (!number_is_greater(&num_s, &num_t))
+			break;
+		number_assign_r(ctx, num_s, num_t);
+	}
+	number_mul_r(ctx, &num_t, &num_s, &num_s);
+	return number_is_equal_r(ctx, &num_t, num_n);
+}
+
+/* res = the n-residue of the small v */
+static void INLINE number_montgomery_small_r(number_ctx_t *ctx, u1024_t *res,
+	int v, u1024_t *num_n)
+{
+	number_small_dec2num_r(ctx, res, (u64)(v < 0 ? -v : v));
+	number_montgomery_product_r(ctx, res, res, &ctx->montgomery->r2, num_n);
+	if (v < 0 && !number_is_equal_r(ctx, res, &NUM_0))
+		number_sub_r(ctx, res, num_n, res);
+}
+
+/* V_2k = V_k^2 - 2Q^k and Q^2k = (Q^k)^2, as n-residues */
+static void INLINE number_lucas_double_v_r(number_ctx_t *ctx, u1024_t *num_v,
+	u1024_t *num_qk, u1024_t *num_n)
+{
+	u64 *v = (u64*)&num_v->arr, *n = (u64*)&num_n->arr;
+	u1024_t num_qk2;
+	u64 *qk2 = (u64*)&num_qk2.arr;
+
+	number_limbs_add_mod(qk2, (u64*)&num_qk->arr, (u64*)&num_qk->arr, n,
+		ctx->block_sz);
+	number_montgomery_square_r(ctx, num_v, num_v, num_n);
+	number_limbs_sub_mod(v, v, qk2, n, ctx->block_sz);
+	number_top_set_r(ctx, num_v);
+	number_montgomery_square_r(ctx, num_qk, num_qk, num_n);
+}
+
+/* strong lucas probable prime test (FIPS 186-4, C.3.3) of an odd n > 2, whose
+ * montgomery context is set. selfridge's parameters: D is the first of 5, -7,
+ * 9, -11, ... for which (D/n) = -1, P = 1 and Q = (1 - D) / 4. a square n has
+ * no such D, and is looked for once a few of them are passed.
+ * with n + 1 = 2^s * k, n passes if U_k == 0 or V_(2^r * k) == 0 for some
+ * 0 <= r < s. U, V and Q^k are n-residues, from k's most significant bit on:
+ *   U_2k = U_k * V_k, V_2k = V_k^2 - 2Q^k
+ *   U_k+1 = (U_k + V_k) / 2, V_k+1 = (D * U_k + V_k) / 2
+ * returns 1 if n is a strong lucas probable prime */
+STATIC int INLINE number_lucas_r(number_ctx_t *ctx, u1024_t *num_n)
+{
+	u1024_t num_k, num_d, num_q, num_u, num_v, num_qk, num_du;
+	u64 *u = (u64*)&num_u.arr, *v = (u64*)&num_v.arr,
+		*du = (u64*)&num_du.arr, *n = (u64*)&num_n->arr;
+	u64 n0_inv = ctx->montgomery->n0_inv;
+	int d, j, i, s, ret;
+
+	TIMER_START(FUNC_NUMBER_LUCAS);
+	for (d = 5; (j = number_jacobi_r(ctx, d, num_n)) == 1;
+		d = d > 0 ? -d - 2 : -d + 2) {
+		if (d == 13 && number_is_square_r(ctx, num_n)) {
+			ret = 0;
+			goto Exit;
+		}
+	}
+	/* n shares a factor with D */
+	if (!j) {
+		number_small_dec2num_r(ctx, &num_d, (u64)(d < 0 ? -d : d));
+		ret = number_is_equal_r(ctx, &num_d, num_n);
+		goto Exit;
+	}
+
+	number_montgomery_small_r(ctx, &num_d, d, num_n);
+	number_montgomery_small_r(ctx, &num_q, (1 - d) / 4, num_n);
+
+	number_add_r(ctx, &num_k, num_n, &NUM_1);
+	s = number_trailing_zeros(&num_k);
+	number_shift_right_r(ctx, &num_k, s);
+
+	/* k = 1 */
+	number_assign_r(ctx, num_u, ctx->montgomery->r);
+	number_assign_r(ctx, num_v, ctx->montgomery->r);
+	number_assign_r(ctx, num_qk, num_q);
+	for (i = number_bit_len(&num_k) - 2; i >= 0; i--) {
+		number_montgomery_product_r(ctx, &num_u, &num_u, &num_v, num_n);
+		number_lucas_double_v_r(ctx, &num_v, &num_qk, num_n);
+		if (!EXPONENT_BIT(&num_k, i))
+			continue;
+
+		number_montgomery_product_r(ctx, &num_du, &num_d, &num_u,
+			num_n);
+		number_limbs_add_mod(u, u, v, n, ctx->block_sz);
+		number_limbs_shift_right_mod(u, n, n0_inv, 1, ctx->block_sz);
+		number_limbs_add_mod(v, v, du, n, ctx->block_sz);
+		number_limbs_shift_right_mod(v, n, n0_inv, 1, ctx->block_sz);
+		number_montgomery_product_r(ctx, &num_qk, &num_qk, &num_q,
+			num_n);
+	}
+	number_top_set_r(ctx, &num_u);
+	number_top_set_r(ctx, &num_v);
+
+	ret = 1;
+	if (number_is_equal_r(ctx, &num_u, &NUM_0) ||
+		number_is_equal_r(ctx, &num_v, &NUM_0)) {
+		goto Exit;
+	}
+	for (i = 1; i < s; i++) {
+		number_lucas_double_v_r(ctx, &num_v, &num_qk, num_n);
+		if (number_is_equal_r(ctx, &num_v, &NUM_0))
+			goto Exit;
+	}
+	ret = 0;
+
+Exit:
+	TIMER_STOP(FUNC_NUMBER_LUCAS);
+	return ret;
+}
+
+/* a base 2 strong probable prime test first rejects almost all composites, at
+ * the cost of a single exponentiation without multiplications. the candidates
+ * passing it are then confirmed by the context's prime test: miller-rabin, or
+ * a strong lucas test, which together with the base 2 test is baillie-psw */
+STATIC int INLINE number_is_prime_r(number_ctx_t *ctx, u1024_t *num_n)
+{
+	number_witness_t witness;
+	u1024_t num_x;
+	int bits, ret;
+
+	TIMER_START(FUNC_NUMBER_IS_PRIME);
+	if (!number_is_odd(num_n) || !number_is_greater(num_n, &NUM_2)) {
+		ret = 0;
+		goto Exit;
+	}
+
+	number_witness_init_r(ctx, &witness, num_n);
+	number_montgomery_power2_r(ctx, &num_x, &witness.u, num_n);
+	if (number_witness_strong_r(ctx, &witness, &num_x, num_n)) {
+		ret = 0;
+		goto Exit;
+	}
+
+	switch (ctx->prime_test) {
+	case NUMBER_PRIME_TEST_BPSW:
+		ret = number_lucas_r(ctx, num_n);
+		break;
+	case NUMBER_PRIME_TEST_MILLER_RABIN:
+	default:
+		/* baillie-psw has no pseudoprimes below 2^64 */
+		bits = number_bit_len(num_n);
+		ret = bits > 64 ? number_miller_rabin_r(ctx, num_n, &witness,
+			number_miller_rabin_rounds(bits)) :
+			number_lucas_r(ctx, num_n);
+		break;
+	}
+
+Exit:
+	TIMER_STOP(FUNC_NUMBER_IS_PRIME);
+	return ret;
+}
+
+/* sets the test confirming number_is_prime_r()'s base 2 strong probable
+ * primes */
+void number_prime_test_set_r(number_ctx_t *ctx, number_prime_test_t test)
+{
+	ctx->prime_test = test;
+}
+
+/* initiate number_generate_coprime_r:small_primes[] fields and generate pi and
+ * incrementor
  */
-static void INLINE number_small_prime_init(small_prime_entry_t *entry,
-	u64 exp_initializer, u1024_t *num_pi, u1024_t *num_increment)
+static void INLINE number_small_prime_init_r(number_ctx_t *ctx,
+	small_prime_entry_t *entry, u64 exp_initializer, u1024_t *num_pi,
+	u1024_t *num_increment)
 {
 	TIMER_START(FUNC_NUMBER_SMALL_PRIME_INIT);
 
 	/* initiate the entry's prime */
-	number_small_dec2num(&(entry->prime), entry->prime_initializer);
+	number_small_dec2num_r(ctx, &(entry->prime),
+		entry->prime_initializer);
 
 	/* initiate the entry's exponent */
-	number_small_dec2num(&(entry->exp), exp_initializer);
+	number_small_dec2num_r(ctx, &(entry->exp), exp_initializer);
 
 	/* raise the entry's prime to the required power */
-	number_exponentiation(&(entry->power_of_prime), &(entry->prime),
-		&(entry->exp));
+	number_exponentiation_r(ctx, &(entry->power_of_prime),
+		&(entry->prime), &(entry->exp));
 
 	/* update pi */
-	number_mul(num_pi, num_pi, &(entry->power_of_prime));
+	number_mul_r(ctx, num_pi, num_pi, &(entry->power_of_prime));
 
 	/* update incrementor */
-	number_mul(num_increment, num_increment, &(entry->prime));
+	number_mul_r(ctx, num_increment, num_increment, &(entry->prime));
 
 	TIMER_STOP(FUNC_NUMBER_SMALL_PRIME_INIT);
 }
@@ -735,26 +2362,27 @@ static void INLINE number_small_prime_init(small_prime_entry_t *entry,
  *   gcd(num_coprime, num_increment) == 1, that is, it does not divided by any
  *   of the first 13 primes
  */
-STATIC void INLINE number_generate_coprime(u1024_t *num_coprime,
-	u1024_t *num_increment)
+STATIC void INLINE number_generate_coprime_r(number_ctx_t *ctx,
+	u1024_t *num_coprime, u1024_t *num_increment)
 {
 	int i;
-	static u1024_t num_pi, num_mod, num_jumper, num_inc;
-	static small_prime_entry_t
-		small_primes[NUMBER_GENERATE_COPRIME_ARRAY_SZ] = {
-		{2}, {3}, {5}, {7}, {11}, {13}, {17}, {19}, {23}, {29}, {31},
-		{37}, {41}
-	};
+	u1024_t num_jumper, num_rem;
+	u64 divisors[NUMBER_GENERATE_COPRIME_ARRAY_SZ];
+	u64 mods[NUMBER_GENERATE_COPRIME_ARRAY_SZ];
+	small_prime_entry_t *small_primes = ctx->small_primes;
 
 #ifdef TESTS
 	if (init_reset) {
-		number_generate_coprime_init = 0;
+		ctx->is_coprime_init = 0;
 		init_reset = 0;
 	}
 #endif
 
 	TIMER_START(FUNC_NUMBER_GENERATE_COPRIME);
-	if (!number_generate_coprime_init) {
+	if (!ctx->is_coprime_init) {
+		static u64 primes[NUMBER_GENERATE_COPRIME_ARRAY_SZ] = {
+			2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41
+		};
 		code2list_t exponents[] = {
 			/* encryption_level 64 is not yet implemented */
 			{64, {}},
@@ -769,39 +2397,44 @@ STATIC void INLINE number_generate_coprime(u1024_t *num_coprime,
 				11}},
 			{-1}
 		};
-		u64 *exp_initializer = code2list(exponents, encryption_level);
+		u64 *exp_initializer = code2list(exponents, ctx->level);
 
 		/* initiate prime, exp and power_of_prime fields in all
 		 * small_primes[] elements. generate num_inc and num_pi at the
 		 * same time. */
-		number_assign(num_pi, NUM_1);
-		number_assign(num_inc, NUM_1);
-		for (i = 0; i < ARRAY_SZ(small_primes); i++) {
-			number_small_prime_init(&small_primes[i],
-				exp_initializer[i], &num_pi, &num_inc);
+		number_assign_r(ctx, ctx->num_pi, NUM_1);
+		number_assign_r(ctx, ctx->num_inc, NUM_1);
+		for (i = 0; i < NUMBER_GENERATE_COPRIME_ARRAY_SZ; i++) {
+			small_primes[i].prime_initializer = primes[i];
+			number_small_prime_init_r(ctx, &small_primes[i],
+				exp_initializer[i], &ctx->num_pi,
+				&ctx->num_inc);
 		}
+		number_barrett_set_r(ctx, &ctx->barrett_pi, &ctx->num_pi);
 
-		number_generate_coprime_init = 1;
+		ctx->is_coprime_init = 1;
 	}
 
 	/* generate num_coprime, such that
 	 * gcd(num_coprime, num_increment) == 1 */
-	number_assign(*num_increment, num_inc);
-	number_assign(*num_coprime, NUM_0);
-	for (i = 0; i < ARRAY_SZ(small_primes); i++) {
+	number_assign_r(ctx, *num_increment, ctx->num_inc);
+	number_assign_r(ctx, *num_coprime, NUM_0);
+	for (i = 0; i < NUMBER_GENERATE_COPRIME_ARRAY_SZ; i++) {
 		u1024_t num_a, num_a_pow;
 
 		do {
-			number_init_random(&num_a, block_sz_u1024/2);
-			number_modular_exponentiation_naive(&num_a_pow, &num_a,
-				&(small_primes[i].exp), &num_pi);
+			number_init_random_r(ctx, &num_a, ctx->block_sz/2);
+			number_modular_exponentiation_barrett_r(ctx,
+				&num_a_pow, &num_a, &(small_primes[i].exp),
+				&ctx->barrett_pi);
 		}
-		while (number_is_equal(&num_a_pow, &NUM_0));
-		number_add(num_coprime, num_coprime, &num_a);
+		while (number_is_equal_r(ctx, &num_a_pow, &NUM_0));
+		number_add_r(ctx, num_coprime, num_coprime, &num_a);
 	}
 
 	/* bound num_coprime to be less than num_pi */
-	number_mod(num_coprime, num_coprime, &num_pi);
+	number_barrett_reduce_r(ctx, num_coprime, num_coprime,
+		&ctx->barrett_pi);
 
 	/* refine num_coprime:
 	 * if num_coprime % small_primes[i].prime == 0, then
@@ -810,162 +2443,918 @@ STATIC void INLINE number_generate_coprime(u1024_t *num_coprime,
 	 * - do: num_coprime = num_coprime + num_jumper
 	 * thus, gcd(num_coprime, small_primes[i].prime) == 1
 	 */
-	number_assign(num_jumper, num_inc);
-	for (i = 0; i < ARRAY_SZ(small_primes); i++) {
-		number_mod(&num_mod, num_coprime, &(small_primes[i].prime));
-		if (number_is_equal(&num_mod, &NUM_0)) {
-			number_dev(&num_jumper, &NUM_0, &num_jumper,
+	for (i = 0; i < NUMBER_GENERATE_COPRIME_ARRAY_SZ; i++)
+		divisors[i] = small_primes[i].prime_initializer;
+	number_mod_small_many_r(ctx, mods, num_coprime, divisors,
+		NUMBER_GENERATE_COPRIME_ARRAY_SZ);
+
+	number_assign_r(ctx, num_jumper, ctx->num_inc);
+	for (i = 0; i < NUMBER_GENERATE_COPRIME_ARRAY_SZ; i++) {
+		if (!mods[i]) {
+			number_dev_r(ctx, &num_jumper, &num_rem, &num_jumper,
 				&(small_primes[i].prime));
 		}
 	}
-	if (!number_is_equal(&num_jumper, &num_inc))
-		number_add(num_coprime, num_coprime, &num_jumper);
+	if (!number_is_equal_r(ctx, &num_jumper, &ctx->num_inc))
+		number_add_r(ctx, num_coprime, num_coprime, &num_jumper);
 	TIMER_STOP(FUNC_NUMBER_GENERATE_COPRIME);
 }
 
+/* a == d, for a single limb d */
+static int ALWAYS_INLINE number_limbs_is_equal_small(u64 *a, int len, u64 d)
+{
+	int i;
+
+	if (a[0] != d)
+		return 0;
+	for (i = 1; i < len && !a[i]; i++);
+	return i == len;
+}
+
+/* res = qa * a - qb * b, modulo 2^(len * BIT_SZ_U64). res must not overlap a
+ * or b */
+static void ALWAYS_INLINE number_limbs_mul_diff(u64 *res, u64 *a, u64 qa,
+	u64 *b, u64 qb, int len)
+{
+	u64 carry = 0, borrow = 0;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		u128 pa = (u128)qa * a[i] + carry;
+		u128 pb = (u128)qb * b[i] + borrow;
+
+		carry = (u64)(pa >> BIT_SZ_U64);
+		borrow = (u64)(pb >> BIT_SZ_U64);
+		borrow += __builtin_sub_overflow((u64)pa, (u64)pb, &res[i]);
+	}
+}
+
+/* lehmer's simulation (TAOCP vol. 2, 4.5.2, algorithm L) of euclid's steps on
+ * a >= b > 0, len limbs long, by the leading BIT_SZ_U64 bits of both.
+ * the steps are accumulated in m[] = { |A|, |B|, |C|, |D| }, replacing (a, b)
+ * by (Aa + Bb, Ca + Db). after an even number of steps A, D >= 0 and B, C <= 0,
+ * after an odd one the other way round. a step is taken only if the quotients
+ * of both ends of the leading bits' range agree, so it is euclid's own.
+ * returns the number of steps */
+static int number_lehmer_steps(u64 *m, u64 *a, u64 *b, int len)
+{
+	int bits = (len - 1) * BIT_SZ_U64 + U64_MSB_IDX(a[len - 1]) + 1;
+	int s = bits > BIT_SZ_U64 ? bits - BIT_SZ_U64 : 0, steps;
+	u128 x = number_limbs_bits(a, len, s), y = number_limbs_bits(b, len, s);
+
+	m[0] = m[3] = 1;
+	m[1] = m[2] = 0;
+	for (steps = 0; ; steps++) {
+		u128 q, q1, c, d;
+
+		if (!(steps & 1)) {
+			if (y <= m[2] || x < m[1])
+				break;
+			q = (x + m[0]) / (y - m[2]);
+			q1 = (x - m[1]) / (y + m[3]);
+		}
+		else {
+			if (y <= m[3] || x < m[0])
+				break;
+			q = (x - m[0]) / (y + m[2]);
+			q1 = (x + m[1]) / (y - m[3]);
+		}
+		c = m[0] + q * m[2];
+		d = m[1] + q * m[3];
+		if (q != q1 || (c | d) >> BIT_SZ_U64)
+			break;
+
+		m[0] = m[2];
+		m[2] = (u64)c;
+		m[1] = m[3];
+		m[3] = (u64)d;
+		c = x - q * y;
+		x = y;
+		y = c;
+	}
+	return steps;
+}
+
+/* (a, b) = (Aa + Bb, Ca + Db) modulo 2^(len * BIT_SZ_U64), for the cofactors of
+ * number_lehmer_steps() */
+static void number_lehmer_apply(u64 *a, u64 *b, u64 *m, int steps, int len)
+{
+	u64 ta[RSA_NUMBER_ARRAY_SZ], tb[RSA_NUMBER_ARRAY_SZ];
+
+	if (!(steps & 1)) {
+		number_limbs_mul_diff(ta, a, m[0], b, m[1], len);
+		number_limbs_mul_diff(tb, b, m[3], a, m[2], len);
+	}
+	else {
+		number_limbs_mul_diff(ta, b, m[1], a, m[0], len);
+		number_limbs_mul_diff(tb, a, m[2], b, m[3], len);
+	}
+	memcpy(a, ta, len * sizeof(u64));
+	memcpy(b, tb, len * sizeof(u64));
+}
+
 /* determine x, y and gcd according to a and b such that:
  * ax+by == gcd(a, b)
+ * euclid's steps are taken a batch at a time by lehmer's single limb cofactors,
+ * so that each batch costs a few passes of limb multiplications over the
+ * operands. a step whose quotient does not fit a limb is taken by a division.
+ * the steps, and so x and y, are those of euclid's algorithm. x and y may both
+ * be NULL when only the gcd is required
  * NOTE: a is assumed to be >= b */
-STATIC void INLINE number_extended_euclid_gcd(u1024_t *gcd, u1024_t *x,
-	u1024_t *a, u1024_t *y, u1024_t *b)
+STATIC void INLINE number_extended_euclid_gcd_r(number_ctx_t *ctx,
+	u1024_t *gcd, u1024_t *x, u1024_t *a, u1024_t *y, u1024_t *b)
 {
 	u1024_t num_x, num_x1, num_x2, num_y, num_y1, num_y2;
 	u1024_t num_a, num_b, num_q, num_r;
-	int change;
+	u64 m[4];
+	int change, steps;
 
 	TIMER_START(FUNC_NUMBER_EXTENDED_EUCLID_GCD);
 	if (number_is_greater_or_equal(a, b)) {
-		number_assign(num_a, *a);
-		number_assign(num_b, *b);
+		number_assign_r(ctx, num_a, *a);
+		number_assign_r(ctx, num_b, *b);
 		change = 0;
 	}
 	else {
-		number_assign(num_a, *b);
-		number_assign(num_b, *a);
+		number_assign_r(ctx, num_a, *b);
+		number_assign_r(ctx, num_b, *a);
 		change = 1;
 	}
 
-	number_assign(num_x1, NUM_0);
-	number_assign(num_x2, NUM_1);
-	number_assign(num_y1, NUM_1);
-	number_assign(num_y2, NUM_0);
+	number_assign_r(ctx, num_x1, NUM_0);
+	number_assign_r(ctx, num_x2, NUM_1);
+	number_assign_r(ctx, num_y1, NUM_1);
+	number_assign_r(ctx, num_y2, NUM_0);
 
 	while (number_is_greater(&num_b, &NUM_0)) {
-		number_dev(&num_q, &num_r, &num_a, &num_b);
-
-		number_mul(&num_x, &num_x1, &num_q);
-		number_sub(&num_x, &num_x2, &num_x);
-		number_mul(&num_y, &num_y1, &num_q);
-		number_sub(&num_y, &num_y2, &num_y);
+		steps = number_lehmer_steps(m, (u64*)&num_a.arr,
+			(u64*)&num_b.arr, num_a.top + 1);
+		if (steps) {
+			number_lehmer_apply((u64*)&num_a.arr, (u64*)&num_b.arr,
+				m, steps, num_a.top + 1);
+			number_top_set_r(ctx, &num_a);
+			number_top_set_r(ctx, &num_b);
+			if (!x)
+				continue;
+
+			number_lehmer_apply((u64*)&num_x2.arr,
+				(u64*)&num_x1.arr, m, steps, ctx->block_sz);
+			number_top_set_r(ctx, &num_x2);
+			number_top_set_r(ctx, &num_x1);
+			number_lehmer_apply((u64*)&num_y2.arr,
+				(u64*)&num_y1.arr, m, steps, ctx->block_sz);
+			number_top_set_r(ctx, &num_y2);
+			number_top_set_r(ctx, &num_y1);
+			continue;
+		}
 
-		number_assign(num_a, num_b);
-		number_assign(num_b, num_r);
-		number_assign(num_x2, num_x1);
-		number_assign(num_x1, num_x);
-		number_assign(num_y2, num_y1);
-		number_assign(num_y1, num_y);
+		number_dev_r(ctx, &num_q, &num_r, &num_a, &num_b);
+		number_assign_r(ctx, num_a, num_b);
+		number_assign_r(ctx, num_b, num_r);
+		if (!x)
+			continue;
+
+		number_mul_r(ctx, &num_x, &num_x1, &num_q);
+		number_sub_r(ctx, &num_x, &num_x2, &num_x);
+		number_mul_r(ctx, &num_y, &num_y1, &num_q);
+		number_sub_r(ctx, &num_y, &num_y2, &num_y);
+
+		number_assign_r(ctx, num_x2, num_x1);
+		number_assign_r(ctx, num_x1, num_x);
+		number_assign_r(ctx, num_y2, num_y1);
+		number_assign_r(ctx, num_y1, num_y);
 	}
 
-	number_assign(*x, change ? num_y2 : num_x2);
-	number_assign(*y, change ? num_x2 : num_y2);
-	number_assign(*gcd, change ? num_b : num_a);
+	if (x) {
+		number_assign_r(ctx, *x, change ? num_y2 : num_x2);
+		number_assign_r(ctx, *y, change ? num_x2 : num_y2);
+	}
+	number_assign_r(ctx, *gcd, num_a);
 	TIMER_STOP(FUNC_NUMBER_EXTENDED_EUCLID_GCD);
 }
 
-STATIC void INLINE number_euclid_gcd(u1024_t *gcd, u1024_t *a, u1024_t *b)
+STATIC void INLINE number_euclid_gcd_r(number_ctx_t *ctx, u1024_t *gcd,
+	u1024_t *a, u1024_t *b)
 {
-	u1024_t x, y;
-
 	TIMER_START(FUNC_NUMBER_EUCLID_GCD);
-	if (number_is_greater_or_equal(a, b))
-		number_extended_euclid_gcd(gcd, &x, a, &y, b);
-	else
-		number_extended_euclid_gcd(gcd, &y, b, &x, a);
+	number_extended_euclid_gcd_r(ctx, gcd, NULL, a, NULL, b);
 	TIMER_STOP(FUNC_NUMBER_EUCLID_GCD);
 }
 
-void number_init_random_coprime(u1024_t *num, u1024_t *coprime)
+void number_init_random_coprime_r(number_ctx_t *ctx, u1024_t *num,
+	u1024_t *coprime)
 {
 	u1024_t num_gcd;
+	barrett_ctx_t range_min1;
 
 	TIMER_START(FUNC_NUMBER_INIT_RANDOM_COPRIME);
+	number_strict_range_set_r(ctx, &range_min1, coprime);
 	do {
-		number_init_random_strict_range(num, coprime);
-		number_euclid_gcd(&num_gcd, num, coprime);
+		number_init_random_strict_range_r(ctx, num, &range_min1);
+		number_euclid_gcd_r(ctx, &num_gcd, num, coprime);
 	}
-	while (!number_is_equal(&num_gcd, &NUM_1));
+	while (!number_is_equal_r(ctx, &num_gcd, &NUM_1));
 	TIMER_STOP(FUNC_NUMBER_INIT_RANDOM_COPRIME);
 }
 
-/* assumption: 0 < num < mod */
-int number_modular_multiplicative_inverse(u1024_t *inv, u1024_t *num,
-	u1024_t *mod)
+/* u = u / 2^k, for u's k trailing zero bits, and x = x / 2^k modulo m */
+static void ALWAYS_INLINE number_limbs_inverse_halve(u64 *u, u64 *x, u64 *m,
+	u64 m_inv, int len)
 {
-	u1024_t num_x, num_y, num_gcd, num_y_abs;
+	while (!(u[0] & 1)) {
+		int k = u[0] ? U64_CTZ(u[0]) : BIT_SZ_U64 - 1;
+
+		number_limbs_shift_right(u, u, len, k);
+		number_limbs_shift_right_mod(x, m, m_inv, k, len);
+	}
+}
+
+/* binary inversion (HAC 14.61, by halvings modulo m in place of its cofactor
+ * pairs): inv = num^(-1) mod m, for an odd m and num < m, each len limbs long.
+ * u = x1 * num and v = x2 * num modulo m, throughout. the trailing zeros of u
+ * and v are shifted out a limb's worth at a time, as a montgomery reduction
+ * does. returns -1 if gcd(num, m) != 1 */
+static int number_limbs_inverse_odd(u64 *inv, u64 *num, u64 *m, int len)
+{
+	u64 u[RSA_NUMBER_ARRAY_SZ], v[RSA_NUMBER_ARRAY_SZ];
+	u64 x1[RSA_NUMBER_ARRAY_SZ], x2[RSA_NUMBER_ARRAY_SZ];
+	u64 m_inv = number_montgomery_n0_inv(m[0]);
+
+	memcpy(u, num, len * sizeof(u64));
+	memcpy(v, m, len * sizeof(u64));
+	memset(x1, 0, len * sizeof(u64));
+	memset(x2, 0, len * sizeof(u64));
+	x1[0] = 1;
+
+	while (!number_limbs_is_equal_small(u, len, 1) &&
+		!number_limbs_is_equal_small(v, len, 1)) {
+		/* u == v != 1 was subtracted */
+		if (number_limbs_is_equal_small(u, len, 0))
+			return -1;
+
+		number_limbs_inverse_halve(u, x1, m, m_inv, len);
+		number_limbs_inverse_halve(v, x2, m, m_inv, len);
+		if (number_limbs_cmp(u, v, len) >= 0) {
+			number_limbs_sub(u, u, v, len);
+			if (number_limbs_sub(x1, x1, x2, len))
+				number_limbs_add(x1, x1, m, len);
+		}
+		else {
+			number_limbs_sub(v, v, u, len);
+			if (number_limbs_sub(x2, x2, x1, len))
+				number_limbs_add(x2, x2, m, len);
+		}
+	}
+
+	memcpy(inv, number_limbs_is_equal_small(u, len, 1) ? x1 : x2,
+		len * sizeof(u64));
+	return 0;
+}
+
+/* assumption: 0 < num < mod
+ * an odd mod is inverted modulo by binary inversion. for an even mod, such as
+ * phi, num must be odd, and w = mod^(-1) mod num is found by binary inversion
+ * instead. then mod * (num - w) == -1 mod num, so:
+ *   inv = (1 + mod * (num - w)) / num
+ * is an integer, inv < mod, and inv * num == 1 mod mod.
+ * returns 0 if num is invertible modulo mod */
+int number_modular_multiplicative_inverse_r(number_ctx_t *ctx, u1024_t *inv,
+	u1024_t *num, u1024_t *mod)
+{
+	u64 product[2 * RSA_NUMBER_ARRAY_SZ], quotient[2 * RSA_NUMBER_ARRAY_SZ];
+	u64 res[RSA_NUMBER_ARRAY_SZ], w[RSA_NUMBER_ARRAY_SZ];
+	u64 *u = (u64*)&num->arr, *m = (u64*)&mod->arr;
+	int len_u, len_m, ret = 0;
 
 	TIMER_START(FUNC_NUMBER_MODULAR_MULTIPLICATIVE_INVERSE);
-	number_extended_euclid_gcd(&num_gcd, &num_x, mod, &num_y, num);
-	number_absolute_value(&num_y_abs, &num_y);
-	number_mod(inv, &num_y_abs, mod);
+	for (len_u = ctx->block_sz; len_u && !u[len_u - 1]; len_u--);
+	for (len_m = ctx->block_sz; len_m && !m[len_m - 1]; len_m--);
+	memset(res, 0, sizeof(res));
 
-	if (!number_is_equal(&num_y_abs, &num_y))
-		number_sub(inv, mod, inv);
+	if (!len_u || len_u > len_m) {
+		ret = -1;
+	}
+	else if (m[0] & 1) {
+		memset(w, 0, sizeof(w));
+		memcpy(w, u, len_u * sizeof(u64));
+		ret = number_limbs_inverse_odd(res, w, m, len_m);
+	}
+	else if (!(u[0] & 1)) {
+		ret = -1;
+	}
+	else if (number_limbs_is_equal_small(u, len_u, 1)) {
+		res[0] = 1;
+	}
+	else {
+		number_limbs_dev(quotient, w, m, len_m, u, len_u);
+		if (!(ret = number_limbs_inverse_odd(w, w, u, len_u))) {
+			number_limbs_sub(w, u, w, len_u);
+			number_limbs_mul(product, len_m + len_u, m, len_m, w,
+				len_u);
+			number_limbs_add_carry(product, product, len_m + len_u,
+				1);
+			number_limbs_dev(quotient, w, product, len_m + len_u, u,
+				len_u);
+			memcpy(res, quotient, len_m * sizeof(u64));
+		}
+	}
+
+	number_reset_r(ctx, inv);
+	memcpy(inv->arr, res, ctx->block_sz * sizeof(u64));
+	number_top_set_r(ctx, inv);
 	TIMER_STOP(FUNC_NUMBER_MODULAR_MULTIPLICATIVE_INVERSE);
-	return !number_gcd_is_1(num, inv);
+	return ret;
 }
 
-void number_find_prime(u1024_t *num)
+/* the residues of a prime candidate modulo the sieve primes, and those of the
+ * increment by which the candidate advances. the sieve primes are the first
+ * size of rsa_primes.h that fit a u64 */
+typedef struct {
+	int size;
+	u64 primes[NUMBER_SIEVE_SZ];
+	u64 residues[NUMBER_SIEVE_SZ];
+	u64 increments[NUMBER_SIEVE_SZ];
+} number_sieve_t;
+
+/* number of sieve primes, by candidate bit length. a candidate's base 2
+ * pretest costs about bits^3 while every sieve prime costs a constant per
+ * candidate, so the sieve pays off up to about bits^2 / 128 primes */
+static int INLINE number_sieve_sz(int bits)
+{
+	return bits > 384 ? 2048 : bits > 192 ? 512 : bits > 96 ? 128 : 32;
+}
+
+/* returns 1 if the candidate is divisible by none of the sieve primes */
+static int number_sieve_init_r(number_ctx_t *ctx, number_sieve_t *sieve,
+	u1024_t *num_candidate, u1024_t *num_increment)
+{
+	int i, ret = 1, size = number_sieve_sz(number_bit_len(num_candidate));
+
+	for (i = 0; i < NUMBER_SIEVE_SZ && i < size &&
+		(u64)number_sieve_primes[i] == number_sieve_primes[i]; i++) {
+		sieve->primes[i] = (u64)number_sieve_primes[i];
+	}
+	sieve->size = i;
+
+	number_mod_small_many_r(ctx, sieve->residues, num_candidate,
+		sieve->primes, sieve->size);
+	number_mod_small_many_r(ctx, sieve->increments, num_increment,
+		sieve->primes, sieve->size);
+	for (i = 0; i < sieve->size; i++)
+		ret &= !!sieve->residues[i];
+	return ret;
+}
+
+/* advances the residues along with the candidate, without overflowing a u64.
+ * returns 1 if the candidate is divisible by none of the sieve primes */
+static int number_sieve_next(number_sieve_t *sieve)
+{
+	int i, ret = 1;
+
+	for (i = 0; i < sieve->size; i++) {
+		u64 gap = sieve->primes[i] - sieve->increments[i];
+
+		if (sieve->residues[i] >= gap)
+			sieve->residues[i] -= gap;
+		else
+			sieve->residues[i] += sieve->increments[i];
+		ret &= !!sieve->residues[i];
+	}
+	return ret;
+}
+
+/* candidates advance by num_increment, keeping them co prime with it. their
+ * residues modulo the sieve primes are advanced alongside by a single limb
+ * addition each, so that only those divisible by none of them are tested by
+ * miller-rabin, whose every round is a modular exponentiation */
+void number_find_prime_r(number_ctx_t *ctx, u1024_t *num)
 {
 	u1024_t num_candidate, num_increment;
+	number_sieve_t sieve;
+	int is_sieved;
 
 	TIMER_START(FUNC_NUMBER_FIND_PRIME);
-	number_generate_coprime(&num_candidate, &num_increment);
+	number_generate_coprime_r(ctx, &num_candidate, &num_increment);
+	is_sieved = number_sieve_init_r(ctx, &sieve, &num_candidate,
+		&num_increment);
 
-	while (!(number_is_prime(&num_candidate))) {
-		number_add(&num_candidate, &num_candidate, &num_increment);
+	while (!is_sieved || !number_is_prime_r(ctx, &num_candidate)) {
+		number_add_r(ctx, &num_candidate, &num_candidate,
+			&num_increment);
+		is_sieved = number_sieve_next(&sieve);
 
 		/* highly unlikely event of rollover rendering
 		 * num_candidate == 1 */
-		if (number_is_equal(&num_candidate, &NUM_1))
-			number_generate_coprime(&num_candidate, &num_increment);
+		if (number_is_equal_r(ctx, &num_candidate, &NUM_1)) {
+			number_generate_coprime_r(ctx, &num_candidate,
+				&num_increment);
+			is_sieved = number_sieve_init_r(ctx, &sieve,
+				&num_candidate, &num_increment);
+		}
 	}
 
-	number_assign(*num, num_candidate);
+	number_assign_r(ctx, *num, num_candidate);
 	TIMER_STOP(FUNC_NUMBER_FIND_PRIME);
 }
 
-int number_str2num(u1024_t *num, char *str)
+/* a prime search shared by number_find_prime_parallel_r()'s workers. the
+ * candidates are start + i * increment, for i = 0, 1, ..., and index is that of
+ * the least one found prime so far, -1 for none */
+typedef struct {
+	pthread_mutex_t lock;
+	int threads;
+	u1024_t start;
+	u1024_t increment;
+	int index;
+	u1024_t prime;
+} number_prime_search_t;
+
+/* a worker tests the candidates i = index, index + threads, ... in a context of
+ * its own */
+typedef struct {
+	number_ctx_t ctx;
+	number_prime_search_t *search;
+	int index;
+	pthread_t thread;
+	int is_thread;
+} number_prime_worker_t;
+
+/* returns 1 while candidate i may still be the least prime of the search.
+ * index is read without the lock, which is only taken to publish a prime */
+static int number_prime_search_is_open(number_prime_search_t *search, int i)
+{
+	int index = __atomic_load_n(&search->index, __ATOMIC_ACQUIRE);
+
+	return index == -1 || i < index;
+}
+
+static void *number_prime_worker(void *arg)
+{
+	number_prime_worker_t *worker = (number_prime_worker_t *)arg;
+	number_prime_search_t *search = worker->search;
+	number_ctx_t *ctx = &worker->ctx;
+	u1024_t num_candidate, num_step;
+	number_sieve_t sieve;
+	int i, is_sieved;
+
+	number_assign_r(ctx, num_candidate, search->start);
+	for (i = 0; i < worker->index; i++) {
+		number_add_r(ctx, &num_candidate, &num_candidate,
+			&search->increment);
+	}
+	number_reset_r(ctx, &num_step);
+	for (i = 0; i < search->threads; i++)
+		number_add_r(ctx, &num_step, &num_step, &search->increment);
+	is_sieved = number_sieve_init_r(ctx, &sieve, &num_candidate,
+		&num_step);
+
+	for (i = worker->index; number_prime_search_is_open(search, i);
+		i += search->threads) {
+		if (is_sieved && number_is_prime_r(ctx, &num_candidate)) {
+			pthread_mutex_lock(&search->lock);
+			if (search->index == -1 || i < search->index) {
+				number_assign_r(ctx, search->prime,
+					num_candidate);
+				__atomic_store_n(&search->index, i,
+					__ATOMIC_RELEASE);
+			}
+			pthread_mutex_unlock(&search->lock);
+			break;
+		}
+
+		number_add_r(ctx, &num_candidate, &num_candidate, &num_step);
+		is_sieved = number_sieve_next(&sieve);
+
+		/* highly unlikely event of rollover, leaving the rest of the
+		 * candidates to the other workers */
+		if (number_is_greater(&num_step, &num_candidate))
+			break;
+	}
+	return NULL;
+}
+
+/* runs the workers of a search, the first by the calling thread. returns the
+ * index of the prime found, or -1 if all of them rolled over */
+static int number_prime_search_run(number_prime_search_t *search,
+	number_prime_worker_t *workers)
+{
+	int w;
+
+	search->index = -1;
+	for (w = 1; w < search->threads; w++) {
+		workers[w].is_thread = !pthread_create(&workers[w].thread, NULL,
+			number_prime_worker, &workers[w]);
+	}
+	number_prime_worker(&workers[0]);
+	for (w = 1; w < search->threads; w++) {
+		if (workers[w].is_thread)
+			pthread_join(workers[w].thread, NULL);
+		else
+			number_prime_worker(&workers[w]);
+	}
+	return search->index;
+}
+
+/* number_find_prime_r() by threads workers, all of the online processors for
+ * 0. the candidates of a single number_generate_coprime_r() starting point are
+ * dealt out to the workers in turn, each sieving and testing its own in a
+ * context seeded by ctx. a worker stops on finding a prime, or once its next
+ * candidate is past the least prime found, so that the prime found is that of
+ * number_find_prime_r() from the same starting point whatever the timing, and
+ * is reproducible for a fixed seed. workers whose thread cannot be created are
+ * run by the calling thread */
+void number_find_prime_parallel_r(number_ctx_t *ctx, u1024_t *num,
+	int threads)
+{
+	number_prime_search_t search;
+	number_prime_worker_t *workers;
+	int w;
+
+	if (threads < 1)
+		threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	if (threads < 2 || !(workers = calloc(threads,
+		sizeof(number_prime_worker_t)))) {
+		number_find_prime_r(ctx, num);
+		return;
+	}
+
+	TIMER_START(FUNC_NUMBER_FIND_PRIME);
+	number_generate_coprime_r(ctx, &search.start, &search.increment);
+	for (w = 0; w < threads; w++) {
+		number_prime_worker_t *worker = &workers[w];
+
+		if (number_ctx_child_init_r(ctx, &worker->ctx, ctx->level))
+			break;
+		worker->ctx.kernels = ctx->kernels;
+		worker->ctx.batch = ctx->batch;
+		worker->ctx.prime_test = ctx->prime_test;
+		worker->search = &search;
+		worker->index = w;
+	}
+
+	/* workers whose context cannot be initiated are left out */
+	if (!(search.threads = w)) {
+		free(workers);
+		TIMER_STOP(FUNC_NUMBER_FIND_PRIME);
+		number_find_prime_r(ctx, num);
+		return;
+	}
+
+	pthread_mutex_init(&search.lock, NULL);
+	while (number_prime_search_run(&search, workers) == -1) {
+		number_generate_coprime_r(ctx, &search.start,
+			&search.increment);
+	}
+
+	number_assign_r(ctx, *num, search.prime);
+	pthread_mutex_destroy(&search.lock);
+	free(workers);
+	TIMER_STOP(FUNC_NUMBER_FIND_PRIME);
+}
+
+int number_str2num_r(number_ctx_t *ctx, u1024_t *num, char *str)
 {
 	u64 *seg;
 
-	if (ASCII_LEN_2_BIN_LEN(str) > encryption_level)
+	if (ASCII_LEN_2_BIN_LEN(str) > ctx->level)
 		return -1;
-	number_reset(num);
+	number_reset_r(ctx, num);
 	sprintf((char *)num, "%s", str);
-	for (seg = (u64*)&num->arr + block_sz_u1024, num->top = block_sz_u1024;
+	for (seg = (u64*)&num->arr + ctx->block_sz, num->top = ctx->block_sz;
 		seg >= (u64*)&num->arr && !*seg; seg--, num->top--);
 	return 0;
 }
 
+/* the number_*() functions: the number_*_r() functions over the global context,
+ * at the global encryption level */
+int number_enclevl_set(int level)
+{
+	if (number_enclevl_set_r(&number_ctx, level))
+		return -1;
+
+	encryption_level = number_ctx.level;
+	block_sz_u1024 = number_ctx.block_sz;
+	return 0;
+}
+
+int number_data2num(u1024_t *num, void *data, int len)
+{
+	return number_data2num_r(number_ctx_global(), num, data, len);
+}
+
+void number_add(u1024_t *res, u1024_t *num1, u1024_t *num2)
+{
+	number_add_r(number_ctx_global(), res, num1, num2);
+}
+
+void number_sub(u1024_t *res, u1024_t *num1, u1024_t *num2)
+{
+	number_sub_r(number_ctx_global(), res, num1, num2);
+}
+
+void number_mul(u1024_t *res, u1024_t *num1, u1024_t *num2)
+{
+	number_mul_r(number_ctx_global(), res, num1, num2);
+}
+
+void number_mul_small_add(u1024_t *res, u1024_t *num, u64 q)
+{
+	number_mul_small_add_r(number_ctx_global(), res, num, q);
+}
+
+void number_dev(u1024_t *num_q, u1024_t *num_r, u1024_t *num_dividend,
+	u1024_t *num_divisor)
+{
+	number_dev_r(number_ctx_global(), num_q, num_r, num_dividend,
+		num_divisor);
+}
+
+u64 number_dev_small(u1024_t *num_r, u1024_t *num_dividend,
+	u1024_t *num_divisor)
+{
+	return number_dev_small_r(number_ctx_global(), num_r, num_dividend,
+		num_divisor);
+}
+
+u64 number_mod_small(u1024_t *num, u64 d)
+{
+	return number_mod_small_r(number_ctx_global(), num, d);
+}
+
+void number_mod_small_many(u64 *rem, u1024_t *num, u64 *d, int count)
+{
+	number_mod_small_many_r(number_ctx_global(), rem, num, d, count);
+}
+
+void number_barrett_set(barrett_ctx_t *barrett, u1024_t *num_n)
+{
+	number_barrett_set_r(number_ctx_global(), barrett, num_n);
+}
+
+void number_barrett_reduce(u1024_t *num_r, u1024_t *num_x,
+	barrett_ctx_t *barrett)
+{
+	number_barrett_reduce_r(number_ctx_global(), num_r, num_x, barrett);
+}
+
+int number_seed_set_random(u1024_t *seed)
+{
+	return number_seed_set_random_r(number_ctx_global(), seed);
+}
+
+int number_seed_set_fixed(u1024_t *seed)
+{
+	return number_seed_set_fixed_r(number_ctx_global(), seed);
+}
+
+int number_init_random(u1024_t *num, int blocks)
+{
+	return number_init_random_r(number_ctx_global(), num, blocks);
+}
+
+void number_init_random_coprime(u1024_t *num, u1024_t *coprime)
+{
+	number_init_random_coprime_r(number_ctx_global(), num, coprime);
+}
+
+void number_find_prime(u1024_t *num)
+{
+	number_find_prime_r(number_ctx_global(), num);
+}
+
+int number_ctx_child_init(number_ctx_t *child, int level)
+{
+	return number_ctx_child_init_r(number_ctx_global(), child, level);
+}
+
+void number_find_prime_parallel(u1024_t *num, int threads)
+{
+	number_find_prime_parallel_r(number_ctx_global(), num, threads);
+}
+
+void number_prime_test_set(number_prime_test_t test)
+{
+	number_prime_test_set_r(number_ctx_global(), test);
+}
+
+void number_montgomery_factor_set(u1024_t *num_n, u1024_t *num_factor)
+{
+	number_montgomery_factor_set_r(number_ctx_global(), num_n, num_factor);
+}
+
+void number_montgomery_factor_get(u1024_t *num)
+{
+	number_montgomery_factor_get_r(number_ctx_global(), num);
+}
+
+void number_exponent_schedule_set(u1024_t *exp)
+{
+	number_exponent_schedule_set_r(number_ctx_global(), exp);
+}
+
+int number_modular_multiplicative_inverse(u1024_t *inv, u1024_t *num,
+	u1024_t *mod)
+{
+	return number_modular_multiplicative_inverse_r(number_ctx_global(),
+		inv, num, mod);
+}
+
+int number_modular_exponentiation_montgomery(u1024_t *res, u1024_t *a,
+	u1024_t *b, u1024_t *n)
+{
+	return number_modular_exponentiation_montgomery_r(number_ctx_global(),
+		res, a, b, n);
+}
+
+int number_modular_exponentiation_montgomery_batch(u1024_t *res, u1024_t *a,
+	int count, u1024_t *b, u1024_t *n)
+{
+	return number_modular_exponentiation_montgomery_batch_r(
+		number_ctx_global(), res, a, count, b, n);
+}
+
+int number_str2num(u1024_t *num, char *str)
+{
+	return number_str2num_r(number_ctx_global(), num, str);
+}
+
+void number_small_dec2num(u1024_t *num_n, u64 dec)
+{
+	number_small_dec2num_r(number_ctx_global(), num_n, dec);
+}
+
 #ifdef TESTS
-STATIC void number_shift_right(u1024_t *num, int n)
+void number_shift_left(u1024_t *num, int n)
 {
-	int i;
+	number_shift_left_r(number_ctx_global(), num, n);
+}
 
-	TIMER_START(FUNC_NUMBER_SHIFT_RIGHT);
-	for (i = 0; i < n; i++)
-		number_shift_right_once(num);
-	TIMER_STOP(FUNC_NUMBER_SHIFT_RIGHT);
+void number_shift_right(u1024_t *num, int n)
+{
+	number_shift_right_r(number_ctx_global(), num, n);
+}
+
+int number_modular_exponentiation_naive(u1024_t *res, u1024_t *a,
+	u1024_t *b, u1024_t *n)
+{
+	return number_modular_exponentiation_naive_r(number_ctx_global(), res,
+		a, b, n);
+}
+
+int number_witness(u1024_t *num_a, u1024_t *num_n)
+{
+	return number_witness_r(number_ctx_global(), num_a, num_n);
+}
+
+int number_is_prime(u1024_t *num_n)
+{
+	return number_is_prime_r(number_ctx_global(), num_n);
+}
+
+int number_modular_multiplication_naive(u1024_t *num_res, u1024_t *num_a,
+	u1024_t *num_b, u1024_t *num_n)
+{
+	return number_modular_multiplication_naive_r(number_ctx_global(),
+		num_res, num_a, num_b, num_n);
+}
+
+int number_modular_multiplication_montgomery(u1024_t *num_res,
+	u1024_t *num_a, u1024_t *num_b, u1024_t *num_n)
+{
+	return number_modular_multiplication_montgomery_r(number_ctx_global(),
+		num_res, num_a, num_b, num_n);
+}
+
+void number_generate_coprime(u1024_t *num_coprime, u1024_t *num_increment)
+{
+	number_generate_coprime_r(number_ctx_global(), num_coprime,
+		num_increment);
+}
+
+void number_exponentiation(u1024_t *res, u1024_t *num_base,
+	u1024_t *num_exp)
+{
+	number_exponentiation_r(number_ctx_global(), res, num_base, num_exp);
+}
+
+void number_extended_euclid_gcd(u1024_t *gcd, u1024_t *x, u1024_t *a,
+	u1024_t *y, u1024_t *b)
+{
+	number_extended_euclid_gcd_r(number_ctx_global(), gcd, x, a, y, b);
+}
+
+void number_absolute_value(u1024_t *abs, u1024_t *num)
+{
+	number_absolute_value_r(number_ctx_global(), abs, num);
+}
+
+/* bit serial multiplication, kept as a reference for number_mul() */
+void number_mul_bitwise(u1024_t *res, u1024_t *num1, u1024_t *num2)
+{
+	int i, top;
+	u1024_t tmp_res, multiplicand = *num1, multiplier = *num2;
+
+	number_reset(&tmp_res);
+	top = num1->top + num2->top + 1;
+	for (i = 0; i < top; i++) {
+		u64 mask = 1;
+		int j;
+
+		for (j = 0; j < bit_sz_u64; j++) {
+			if ((*((u64*)&multiplier.arr + i)) & mask)
+				number_add(&tmp_res, &tmp_res, &multiplicand);
+			number_shift_left_once(&multiplicand);
+			number_reset_buffer(&multiplicand);
+			mask = mask << 1;
+		}
+	}
+	number_assign(*res, tmp_res);
 }
 
-STATIC void number_shift_left(u1024_t *num, int n)
+/* sets the batch engine by name, if the cpu supports it */
+int number_batch_set_r(number_ctx_t *ctx, char *name)
 {
 	int i;
 
-	TIMER_START(FUNC_NUMBER_SHIFT_LEFT);
-	for (i = 0; i < n; i++)
-		number_shift_left_once(num);
-	TIMER_STOP(FUNC_NUMBER_SHIFT_LEFT);
+	for (i = 0; i < ARRAY_SZ(number_batches); i++) {
+		number_batch_t *batch = number_batches[i];
+
+		if (strcmp(batch->name, name))
+			continue;
+		if (batch->is_supported && !batch->is_supported())
+			return -1;
+		ctx->batch = batch;
+		return 0;
+	}
+	return -1;
+}
+
+/* sets the kernels of any block size, kept as a reference for the fixed size
+ * ones */
+void number_kernels_generic_set_r(number_ctx_t *ctx)
+{
+	ctx->kernels = &number_kernels_generic;
+}
+
+/* shift and subtract montgomery factor, 2^(2*(encryption_level+2)) % num_n,
+ * kept as a reference for number_montgomery_factor_set() */
+void number_montgomery_factor_shift(u1024_t *num_factor, u1024_t *num_n)
+{
+	int exp, exp_max, i, n_bit_len;
+
+	exp_max = 2*(encryption_level+2);
+	number_small_dec2num(num_factor, (u64)1);
+	n_bit_len = number_bit_len(num_n);
+
+	/* factor < n: shifting it up to n's bit length, or by one if it is
+	 * already there, keeps it below 2n */
+	for (exp = 0; exp < exp_max; exp += i) {
+		i = n_bit_len - number_bit_len(num_factor);
+		if (!i)
+			i = 1;
+		if (i > exp_max - exp)
+			i = exp_max - exp;
+
+		number_shift_left(num_factor, i);
+		if (number_is_greater_or_equal(num_factor, num_n))
+			number_sub(num_factor, num_factor, num_n);
+	}
+}
+
+/* bit serial long division, kept as a reference for number_dev() */
+void number_dev_bitwise(u1024_t *num_q, u1024_t *num_r,
+	u1024_t *num_dividend, u1024_t *num_divisor)
+{
+	u1024_t dividend, divisor, quotient, remainder;
+	u64 *seg_dividend = (u64 *)&dividend.arr + block_sz_u1024 - 1;
+	u64 *remainder_ptr = (u64 *)&remainder.arr;
+	u64 *quotient_ptr = (u64 *)&quotient.arr;
+
+	number_assign(dividend, *num_dividend);
+	number_assign(divisor, *num_divisor);
+	number_reset(&remainder);
+	number_reset(&quotient);
+	while (seg_dividend >= (u64 *)&dividend) {
+		u64 mask_dividend = MSB(u64);
+
+		while (mask_dividend) {
+			number_shift_left_once(&remainder);
+			number_reset_buffer(&remainder);
+			number_shift_left_once(&quotient);
+			number_reset_buffer(&quotient);
+			*remainder_ptr = *remainder_ptr |
+				((*seg_dividend & mask_dividend) ?
+				 (u64)1 : (u64)0);
+			if (number_is_greater_or_equal(&remainder, &divisor)){
+				*quotient_ptr = *quotient_ptr | (u64)1;
+				number_sub(&remainder, &remainder, &divisor);
+			}
+			mask_dividend = mask_dividend >> 1;
+		}
+		seg_dividend--;
+	}
+	number_assign(*num_q, quotient);
+	number_assign(*num_r, remainder);
 }
 
 static u64 *number_get_seg(u1024_t *num, int seg)
@@ -17,22 +17,28 @@ typedef enum {
 	FUNC_NUMBER_FIND_MOST_SIGNIFICANT_SET_BIT,
 	FUNC_NUMBER_ADD,
 	FUNC_NUMBER_SMALL_DEC2NUM,
-	FUNC_NUMBER_2COMPLEMENT,
 	FUNC_NUMBER_SUB,
 	FUNC_NUMBER_MUL,
+	FUNC_NUMBER_MUL_SMALL_ADD,
 	FUNC_NUMBER_MODULAR_MULTIPLICATION_NAIVE,
 	FUNC_NUMBER_MODULAR_MULTIPLICATION_MONTGOMERY,
 	FUNC_NUMBER_ABSOLUTE_VALUE,
 	FUNC_NUMBER_DEV,
+	FUNC_NUMBER_DEV_SMALL,
+	FUNC_NUMBER_MOD_SMALL,
+	FUNC_NUMBER_BARRETT_REDUCE,
 	FUNC_NUMBER_INIT_RANDOM_STRICT_RANGE,
 	FUNC_NUMBER_EXPONENTIATION,
 	FUNC_NUMBER_MODULAR_EXPONENTIATION_NAIVE,
 	FUNC_NUMBER_MONTGOMERY_FACTOR_SET,
 	FUNC_NUMBER_MONTGOMERY_PRODUCT,
+	FUNC_NUMBER_MONTGOMERY_SQUARE,
 	FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY,
+	FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY_BATCH,
 	FUNC_NUMBER_WITNESS_INIT,
 	FUNC_NUMBER_WITNESS,
 	FUNC_NUMBER_MILLER_RABIN,
+	FUNC_NUMBER_LUCAS,
 	FUNC_NUMBER_IS_PRIME,
 	FUNC_NUMBER_IS_PRIME1,
 	FUNC_NUMBER_IS_PRIME2,
@@ -51,18 +57,23 @@ typedef enum {
 #ifdef TESTS
 #if defined(UCHAR)
 #define U64_TYPE unsigned char
+#define U128_TYPE unsigned short
 #elif defined(USHORT)
 #define U64_TYPE unsigned short
+#define U128_TYPE unsigned int
 #elif defined(UINT)
 #define U64_TYPE unsigned int
+#define U128_TYPE unsigned long long
 #elif defined(ULLONG)
 #define U64_TYPE unsigned long long
+#define U128_TYPE unsigned __int128
 #if !defined(ULLONG)
 #define ULLONG
 #endif
 #endif
 
 typedef U64_TYPE u64;
+typedef U128_TYPE u128;
 #define STATIC
 #define INLINE
 
@@ -79,14 +90,21 @@ inline void timer_stop(func_cnt_t func);
 #define TIMER_START(FUNC)
 #define TIMER_STOP(FUNC)
 typedef unsigned long long u64;
+typedef unsigned __int128 u128;
 #define STATIC static
 #define INLINE inline
 #endif /* TESTS */
 
 #ifdef MERSENNE_TWISTER
+#include "mt19937_64.h"
+
 typedef unsigned long long prng_seed_t;
+typedef mt19937_64_t prng_state_t;
 #else
 typedef unsigned int prng_seed_t;
+typedef struct {
+	unsigned short xsubi[3]; /* nrand48() state */
+} prng_state_t;
 #endif
 
 #define RSA_NUMBER_ARRAY_SZ 17
@@ -98,8 +116,13 @@ typedef struct {
 
 #define MSB(X) ((X)(~((X)-1 >> 1)))
 
-#define NUMBER_IS_NEGATIVE(X) ((MSB(u64) & \
-	*((u64*)(X) + (block_sz_u1024 - 1))) ? 1 : 0)
+/* compile time equivalent of bit_sz_u64, for use in limb level arithmetic */
+#define BIT_SZ_U64 ((int)sizeof(u64) << 3)
+
+#define NUMBER_IS_NEGATIVE_SZ(X, BLOCK_SZ) ((MSB(u64) & \
+	*((u64*)(X) + ((BLOCK_SZ) - 1))) ? 1 : 0)
+#define NUMBER_IS_NEGATIVE(X) NUMBER_IS_NEGATIVE_SZ(X, block_sz_u1024)
+#define NUMBER_IS_NEGATIVE_R(CTX, X) NUMBER_IS_NEGATIVE_SZ(X, (CTX)->block_sz)
 
 #define RSA_PTASK_START(FMT, ...) printf(FMT ":\n", ##__VA_ARGS__); \
 	fflush(stdout)
@@ -109,19 +132,27 @@ typedef struct {
 
 #define number_is_odd(num) (*(u64*)&(num)->arr & (u64)1)
 
-#define number_reset_buffer(num) do { \
-	*((u64*)&(num)->arr + block_sz_u1024) = 0; \
-	if ((num)->top == block_sz_u1024) \
+/* the *_sz() macros take the number of u64 blocks at the encryption level
+ * explicitly. each is wrapped by a number_*() form, at the global encryption
+ * level, and by a number_*_r() form, at the level of a number context */
+#define number_reset_buffer_sz(num, block_sz) do { \
+	*((u64*)&(num)->arr + (block_sz)) = 0; \
+	if ((num)->top == (block_sz)) \
 		while ((num)->top && !*((u64*)&(num)->arr + --(num)->top)); \
 } while (0)
+#define number_reset_buffer(num) number_reset_buffer_sz(num, block_sz_u1024)
+#define number_reset_buffer_r(ctx, num) \
+	number_reset_buffer_sz(num, (ctx)->block_sz)
 
-#define number_reset(num) do { \
+#define number_reset_sz(num, block_sz) do { \
 	int __i; \
-	for (__i = 0; __i <= block_sz_u1024; __i++) \
+	for (__i = 0; __i <= (block_sz); __i++) \
 		(num)->arr[__i] = 0; \
 	(num)->top = 0; \
 } \
 while (0)
+#define number_reset(num) number_reset_sz(num, block_sz_u1024)
+#define number_reset_r(ctx, num) number_reset_sz(num, (ctx)->block_sz)
 
 #define number_shift_right_once(num) do { \
 	u64 *__seg, *__top; \
@@ -159,6 +190,12 @@ while (0)
 	number_sub((num), (num), &__num_1); \
 } while (0)
 
+#define number_sub1_r(ctx, num) do { \
+	u1024_t __num_1; \
+	number_assign_r((ctx), __num_1, NUM_1); \
+	number_sub_r((ctx), (num), (num), &__num_1); \
+} while (0)
+
 /* return: num1 > num2 or ret_on_equal if num1 == num2 */
 #define number_compare(num1, num2, ret_on_equal) ({ \
 	int __ret; \
@@ -185,36 +222,55 @@ while (0)
 #define number_is_greater_or_equal(num1, num2) number_compare((num1), (num2), 1)
 
 /* return: num1 == num2 */
-#define number_is_equal(num1, num2) ((num1)->top == (num2)->top && \
-	!memcmp((num1), (num2), encryption_level>>3))
+#define number_is_equal_sz(num1, num2, block_sz) \
+	((num1)->top == (num2)->top && \
+	!memcmp((num1), (num2), (block_sz) * sizeof(u64)))
+#define number_is_equal(num1, num2) \
+	number_is_equal_sz(num1, num2, block_sz_u1024)
+#define number_is_equal_r(ctx, num1, num2) \
+	number_is_equal_sz(num1, num2, (ctx)->block_sz)
 
 #define number_mod(r, a, n) do { \
 	u1024_t __q; \
 	number_dev(&__q, (r), (a), (n)); \
 } while (0)
 
-#define number_top_set(num) do { \
+#define number_mod_r(ctx, r, a, n) do { \
+	u1024_t __q; \
+	number_dev_r((ctx), &__q, (r), (a), (n)); \
+} while (0)
+
+#define number_top_set_sz(num, block_sz) do { \
 	u64 *__seg; \
-	for (__seg = (u64*)&(num)->arr + block_sz_u1024, \
-		(num)->top = block_sz_u1024; \
+	for (__seg = (u64*)&(num)->arr + (block_sz), \
+		(num)->top = (block_sz); \
 		__seg > (u64*)&(num)->arr && !*__seg; __seg--, (num)->top--); \
 } while (0)
+#define number_top_set(num) number_top_set_sz(num, block_sz_u1024)
+#define number_top_set_r(ctx, num) number_top_set_sz(num, (ctx)->block_sz)
 
-#define number_xor(res, num1, num2) do { \
+#define number_xor_sz(res, num1, num2, block_sz) do { \
 	u64 *__seg, *__seg1, *__seg2; \
-	for (__seg = (u64*)&(res)->arr + block_sz_u1024, \
-		__seg1 = (u64*)&(num1)->arr + block_sz_u1024, \
-		__seg2 = (u64*)&(num2)->arr + block_sz_u1024; \
+	for (__seg = (u64*)&(res)->arr + (block_sz), \
+		__seg1 = (u64*)&(num1)->arr + (block_sz), \
+		__seg2 = (u64*)&(num2)->arr + (block_sz); \
 		__seg >= (u64*)&(res)->arr; *__seg-- = *__seg1-- ^ *__seg2--); \
-	number_top_set(res); \
+	number_top_set_sz(res, block_sz); \
 } while (0)
+#define number_xor(res, num1, num2) \
+	number_xor_sz(res, num1, num2, block_sz_u1024)
+#define number_xor_r(ctx, res, num1, num2) \
+	number_xor_sz(res, num1, num2, (ctx)->block_sz)
 
-#define number_assign(to, from) do { \
+#define number_assign_sz(to, from, block_sz) do { \
 	int __i; \
-	for (__i = 0; __i <= block_sz_u1024; __i++) \
+	for (__i = 0; __i <= (block_sz); __i++) \
 		(to).arr[__i] = (from).arr[__i]; \
 	(to).top = (from).top; \
 } while (0)
+#define number_assign(to, from) number_assign_sz(to, from, block_sz_u1024)
+#define number_assign_r(ctx, to, from) \
+	number_assign_sz(to, from, (ctx)->block_sz)
 
 extern u1024_t NUM_0;
 extern u1024_t NUM_1;
@@ -233,31 +289,200 @@ typedef struct {
 	u1024_t power_of_prime;
 } small_prime_entry_t;
 
+/* montgomery context of a modulus, n, at an encryption level.
+ * R = 2^level */
+typedef struct {
+	int level; /* 0 for an unused context */
+	u1024_t n;
+	u1024_t r2; /* R^2 % n */
+	u1024_t r; /* R % n, the n-residue of 1 */
+	u1024_t factor; /* 2^(2*(level+2)) % n, as stored in the key files */
+	u64 n0_inv; /* -n^-1 % 2^bit_sz_u64 */
+} montgomery_ctx_t;
+
+#define MONTGOMERY_CACHE_SZ 8
+
+/* barrett context of a modulus, n, of k limbs. mu = B^(2k) / n, of k + 1
+ * limbs, where B = 2^bit_sz_u64 */
+typedef struct {
+	u1024_t n;
+	int k;
+	u64 mu[RSA_NUMBER_ARRAY_SZ];
+} barrett_ctx_t;
+
+/* how number_is_prime_r() confirms its base 2 strong probable primes */
+typedef enum {
+	NUMBER_PRIME_TEST_MILLER_RABIN, /* random bases, by bit length */
+	NUMBER_PRIME_TEST_BPSW, /* strong lucas, making for baillie-psw */
+} number_prime_test_t;
+
+/* windows in the recoding of an exponent of up to RSA_NUMBER_ARRAY_SZ - 1
+ * limbs */
+#define EXPONENT_SCHEDULE_SZ (BIT_SZ_U64 * (RSA_NUMBER_ARRAY_SZ - 1))
+
+/* sliding window recoding of an exponent, exp, at an encryption level, for the
+ * montgomery exponentiation to replay: r = g[window[0]], then for each
+ * following window, k, r = r^(2^squares[k]) * g[window[k]], and at last
+ * r = r^(2^squares_tail), where g[i] = a^(2i+1) */
+typedef struct {
+	int level; /* 0 for an unset schedule */
+	u1024_t exp;
+	int window_sz;
+	int windows; /* 0 for exp = 0 */
+	int squares_tail;
+	unsigned short squares[EXPONENT_SCHEDULE_SZ];
+	unsigned char window[EXPONENT_SCHEDULE_SZ];
+} exponent_schedule_t;
+
+#define NUMBER_GENERATE_COPRIME_ARRAY_SZ 13
+
+/* limb kernels over len limbs, the block size of a level. res may be any of
+ * the operands, other than in mul(). see number_limbs_*() */
+typedef struct {
+	int block_sz; /* fixed len of the kernels, 0 for any len */
+	char *name;
+	u64 (*add)(u64 *res, u64 *a, u64 *b, int len);
+	u64 (*sub)(u64 *res, u64 *a, u64 *b, int len);
+	/* the low len + 1 limbs of a * b */
+	void (*mul)(u64 *res, u64 *a, u64 *b, int len);
+	void (*montgomery_product)(u64 *res, u64 *a, u64 *b, u64 *n,
+		u64 n0_inv, int len);
+	void (*montgomery_square)(u64 *res, u64 *a, u64 *n, u64 n0_inv,
+		int len);
+} number_kernels_t;
+
+/* batch montgomery exponentiation engine, exponentiating lanes blocks at once
+ * by vector instructions.
+ * see number_modular_exponentiation_montgomery_batch_r() */
+typedef struct {
+	char *name;
+	int lanes; /* blocks per vector, 1 for the scalar engine */
+	int radix; /* bits per limb */
+	int (*is_supported)(void); /* by the cpu, NULL if always */
+	void (*montgomery_product)(u64 *res, u64 *a, u64 *b, u64 *n,
+		u64 n0_inv, int len);
+} number_batch_t;
+
+/* a number context: the encryption level along with the montgomery and random
+ * number generation state of the number_*_r() functions. as nothing else is
+ * shared, contexts may be used concurrently by different threads.
+ * the number_*() functions use a global context, at the global encryption
+ * level, whose random numbers are those of RSA_RANDOM().
+ * a context is set by number_ctx_init() and must not be copied */
+typedef struct {
+	int level; /* encryption level */
+	int block_sz; /* u64 blocks in a number, level / bit_sz_u64 */
+	number_kernels_t *kernels; /* limb kernels of block_sz limbs */
+	number_batch_t *batch; /* batch exponentiation engine */
+
+	/* montgomery contexts, most recently used first. montgomery is the one
+	 * set by number_montgomery_factor_set_r() */
+	montgomery_ctx_t montgomery_cache[MONTGOMERY_CACHE_SZ];
+	montgomery_ctx_t *montgomery_lru[MONTGOMERY_CACHE_SZ];
+	montgomery_ctx_t *montgomery;
+
+	/* recoding of the exponent set by number_exponent_schedule_set_r() */
+	exponent_schedule_t exponent_schedule;
+
+	/* number_generate_coprime_r() tables at level */
+	int is_coprime_init;
+	u1024_t num_pi;
+	u1024_t num_inc;
+	barrett_ctx_t barrett_pi; /* of num_pi */
+	small_prime_entry_t small_primes[NUMBER_GENERATE_COPRIME_ARRAY_SZ];
+	number_prime_test_t prime_test; /* of number_is_prime_r() */
+
+	/* random number generator, NULL for that of RSA_RANDOM() */
+	prng_state_t *prng;
+	prng_seed_t *seed;
+	prng_state_t prng_state;
+	prng_seed_t prng_seed;
+} number_ctx_t;
+
+int number_ctx_init(number_ctx_t *ctx, int level, prng_seed_t seed);
+int number_ctx_child_init_r(number_ctx_t *ctx, number_ctx_t *child,
+	int level);
+int number_enclevl_set_r(number_ctx_t *ctx, int level);
+int number_data2num_r(number_ctx_t *ctx, u1024_t *num, void *data, int len);
+void number_add_r(number_ctx_t *ctx, u1024_t *res, u1024_t *num1,
+	u1024_t *num2);
+void number_sub_r(number_ctx_t *ctx, u1024_t *res, u1024_t *num1,
+	u1024_t *num2);
+void number_mul_r(number_ctx_t *ctx, u1024_t *res, u1024_t *num1,
+	u1024_t *num2);
+void number_mul_small_add_r(number_ctx_t *ctx, u1024_t *res, u1024_t *num,
+	u64 q);
+void number_dev_r(number_ctx_t *ctx, u1024_t *num_q, u1024_t *num_r,
+	u1024_t *num_dividend, u1024_t *num_divisor);
+u64 number_dev_small_r(number_ctx_t *ctx, u1024_t *num_r,
+	u1024_t *num_dividend, u1024_t *num_divisor);
+u64 number_mod_small_r(number_ctx_t *ctx, u1024_t *num, u64 d);
+void number_mod_small_many_r(number_ctx_t *ctx, u64 *rem, u1024_t *num,
+	u64 *d, int count);
+void number_barrett_set_r(number_ctx_t *ctx, barrett_ctx_t *barrett,
+	u1024_t *num_n);
+void number_barrett_reduce_r(number_ctx_t *ctx, u1024_t *num_r,
+	u1024_t *num_x, barrett_ctx_t *barrett);
+int number_seed_set_random_r(number_ctx_t *ctx, u1024_t *seed);
+int number_seed_set_fixed_r(number_ctx_t *ctx, u1024_t *seed);
+int number_init_random_r(number_ctx_t *ctx, u1024_t *num, int blocks);
+void number_init_random_coprime_r(number_ctx_t *ctx, u1024_t *num,
+	u1024_t *coprime);
+void number_find_prime_r(number_ctx_t *ctx, u1024_t *num);
+void number_find_prime_parallel_r(number_ctx_t *ctx, u1024_t *num,
+	int threads);
+void number_prime_test_set_r(number_ctx_t *ctx, number_prime_test_t test);
+void number_montgomery_factor_set_r(number_ctx_t *ctx, u1024_t *num_n,
+	u1024_t *num_factor);
+void number_montgomery_factor_get_r(number_ctx_t *ctx, u1024_t *num);
+void number_exponent_schedule_set_r(number_ctx_t *ctx, u1024_t *exp);
+int number_modular_multiplicative_inverse_r(number_ctx_t *ctx, u1024_t *inv,
+	u1024_t *num, u1024_t *mod);
+int number_modular_exponentiation_montgomery_r(number_ctx_t *ctx,
+	u1024_t *res, u1024_t *a, u1024_t *b, u1024_t *n);
+int number_modular_exponentiation_montgomery_batch_r(number_ctx_t *ctx,
+	u1024_t *res, u1024_t *a, int count, u1024_t *b, u1024_t *n);
+int number_str2num_r(number_ctx_t *ctx, u1024_t *num, char *str);
+void number_small_dec2num_r(number_ctx_t *ctx, u1024_t *num_n, u64 dec);
+
 int number_enclevl_set(int level);
 int number_data2num(u1024_t *num, void *data, int len);
 int number_size(int level);
 void number_add(u1024_t *res, u1024_t *num1, u1024_t *num2);
 void number_sub(u1024_t *res, u1024_t *num1, u1024_t *num2);
 void number_mul(u1024_t *res, u1024_t *num1, u1024_t *num2);
+void number_mul_small_add(u1024_t *res, u1024_t *num, u64 q);
 void number_dev(u1024_t *num_q, u1024_t *num_r, u1024_t *num_dividend,
 	u1024_t *num_divisor);
+u64 number_dev_small(u1024_t *num_r, u1024_t *num_dividend,
+	u1024_t *num_divisor);
+u64 number_mod_small(u1024_t *num, u64 d);
+void number_mod_small_many(u64 *rem, u1024_t *num, u64 *d, int count);
+void number_barrett_set(barrett_ctx_t *barrett, u1024_t *num_n);
+void number_barrett_reduce(u1024_t *num_r, u1024_t *num_x,
+	barrett_ctx_t *barrett);
 int number_seed_set_random(u1024_t *seed);
 int number_seed_set_fixed(u1024_t *seed);
 int number_init_random(u1024_t *num, int blocks);
 void number_init_random_coprime(u1024_t *num, u1024_t *coprime);
 void number_find_prime(u1024_t *num);
+int number_ctx_child_init(number_ctx_t *child, int level);
+void number_find_prime_parallel(u1024_t *num, int threads);
+void number_prime_test_set(number_prime_test_t test);
 void number_montgomery_factor_set(u1024_t *num_n, u1024_t *num_factor);
 void number_montgomery_factor_get(u1024_t *num);
+void number_exponent_schedule_set(u1024_t *exp);
 int number_modular_multiplicative_inverse(u1024_t *inv, u1024_t *num,
 	u1024_t *mod);
 int number_modular_exponentiation_montgomery(u1024_t *res, u1024_t *a,
 	u1024_t *b, u1024_t *n);
+int number_modular_exponentiation_montgomery_batch(u1024_t *res, u1024_t *a,
+	int count, u1024_t *b, u1024_t *n);
 int number_str2num(u1024_t *num, char *str);
 void number_small_dec2num(u1024_t *num_n, u64 dec);
 
 #ifdef TESTS
 extern int init_reset;
-extern u1024_t num_montgomery_n;
 extern prng_seed_t number_random_seed;
 
 int number_init_str(u1024_t *num, char *init_str);
@@ -268,6 +493,10 @@ void number_dev(u1024_t *num_q, u1024_t *num_r, u1024_t *num_dividend,
 	u1024_t *num_divisor);
 int number_find_most_significant_set_bit(u1024_t *num, u64 **seg,
 	u64 *mask);
+void number_mul_bitwise(u1024_t *res, u1024_t *num1, u1024_t *num2);
+void number_dev_bitwise(u1024_t *num_q, u1024_t *num_r,
+	u1024_t *num_dividend, u1024_t *num_divisor);
+void number_montgomery_factor_shift(u1024_t *num_factor, u1024_t *num_n);
 int number_modular_exponentiation_naive(u1024_t *res, u1024_t *a,
 	u1024_t *b, u1024_t *n);
 int number_witness(u1024_t *num_a, u1024_t *num_n);
@@ -284,6 +513,27 @@ void number_exponentiation(u1024_t *res, u1024_t *num_base,
 void number_extended_euclid_gcd(u1024_t *gcd, u1024_t *x, u1024_t *a,
 	u1024_t *y, u1024_t *b);
 void number_absolute_value(u1024_t *abs, u1024_t *num);
+
+void number_shift_left_r(number_ctx_t *ctx, u1024_t *num, int n);
+void number_shift_right_r(number_ctx_t *ctx, u1024_t *num, int n);
+int number_modular_exponentiation_naive_r(number_ctx_t *ctx, u1024_t *res,
+	u1024_t *a, u1024_t *b, u1024_t *n);
+int number_witness_r(number_ctx_t *ctx, u1024_t *num_a, u1024_t *num_n);
+int number_is_prime_r(number_ctx_t *ctx, u1024_t *num_s);
+int number_lucas_r(number_ctx_t *ctx, u1024_t *num_n);
+int number_modular_multiplication_naive_r(number_ctx_t *ctx,
+	u1024_t *num_res, u1024_t *num_a, u1024_t *num_b, u1024_t *num_n);
+int number_modular_multiplication_montgomery_r(number_ctx_t *ctx,
+	u1024_t *num_res, u1024_t *num_a, u1024_t *num_b, u1024_t *num_n);
+void number_generate_coprime_r(number_ctx_t *ctx, u1024_t *num_coprime,
+	u1024_t *num_increment);
+void number_exponentiation_r(number_ctx_t *ctx, u1024_t *res,
+	u1024_t *num_base, u1024_t *num_exp);
+void number_extended_euclid_gcd_r(number_ctx_t *ctx, u1024_t *gcd, u1024_t *x,
+	u1024_t *a, u1024_t *y, u1024_t *b);
+void number_absolute_value_r(number_ctx_t *ctx, u1024_t *abs, u1024_t *num);
+void number_kernels_generic_set_r(number_ctx_t *ctx);
+int number_batch_set_r(number_ctx_t *ctx, char *name);
 #endif
 
 #endif
@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* generates rsa_primes.h at build time: the first n primes, sieved off prime
+ * candidates by number_find_prime() before they are tested by miller-rabin.
+ * the primes are kept below 2^16, where there are 6542 of them */
+
+#define PRIMES_BOUND (1 << 16)
+#define PRIMES_PER_LINE 10
+
+int main(int argc, char *argv[])
+{
+	static char is_composite[PRIMES_BOUND];
+	int n, i, j, count;
+	char *err;
+
+	n = argc == 2 ? strtol(argv[1], &err, 10) : 0;
+	if (argc != 2 || *err || n < 1) {
+		fprintf(stderr, "usage: %s <number of primes>\n", argv[0]);
+		return 1;
+	}
+
+	memset(is_composite, 0, sizeof(is_composite));
+	for (i = 2; i * i < PRIMES_BOUND; i++) {
+		if (is_composite[i])
+			continue;
+		for (j = i * i; j < PRIMES_BOUND; j += i)
+			is_composite[j] = 1;
+	}
+	for (i = 2, count = 0; i < PRIMES_BOUND; i++)
+		count += !is_composite[i];
+	if (n > count) {
+		fprintf(stderr, "%s: at most %d primes are below %d\n", argv[0],
+			count, PRIMES_BOUND);
+		return 1;
+	}
+
+	printf("/* generated by rsa_primes_gen, do not edit */\n");
+	printf("#ifndef _RSA_PRIMES_H_\n");
+	printf("#define _RSA_PRIMES_H_\n\n");
+	printf("#define NUMBER_SIEVE_SZ %d\n\n", n);
+	printf("static unsigned short number_sieve_primes[NUMBER_SIEVE_SZ] = "
+		"{");
+	for (i = 2, count = 0; count < n; i++) {
+		if (is_composite[i])
+			continue;
+		if (count % PRIMES_PER_LINE)
+			printf(", %d", i);
+		else
+			printf("%s\n\t%d", count ? "," : "", i);
+		count++;
+	}
+	printf("\n};\n\n");
+	printf("#endif\n");
+
+	return 0;
+}
@@ -6,6 +6,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <math.h>
+#include <pthread.h>
 
 #define B (8)
 #define K (1024)
@@ -241,15 +242,18 @@ func_t func_table[FUNC_COUNT] = {
 	{"number_find_most_significant_set_bit ", 1},
 	[ FUNC_NUMBER_ADD ] = {"number_add", 1},
 	[ FUNC_NUMBER_SMALL_DEC2NUM ] = {"func_number_small_dec2num", 1},
-	[ FUNC_NUMBER_2COMPLEMENT ] = {"number_2complement", 1},
 	[ FUNC_NUMBER_SUB ] = {"number_sub", 1},
 	[ FUNC_NUMBER_MUL ] = {"number_mul", 1},
+	[ FUNC_NUMBER_MUL_SMALL_ADD ] = {"number_mul_small_add", 1},
 	[ FUNC_NUMBER_MODULAR_MULTIPLICATION_NAIVE ] =
 	{"number_modular_multiplication_naive", 1},
 	[ FUNC_NUMBER_MODULAR_MULTIPLICATION_MONTGOMERY ] =
 	{"number_modular_multiplication_montgomery", 1},
 	[ FUNC_NUMBER_ABSOLUTE_VALUE ] = {"number_absolute_value", 1},
 	[ FUNC_NUMBER_DEV ] = {"number_dev", 1},
+	[ FUNC_NUMBER_DEV_SMALL ] = {"number_dev_small", 1},
+	[ FUNC_NUMBER_MOD_SMALL ] = {"number_mod_small", 1},
+	[ FUNC_NUMBER_BARRETT_REDUCE ] = {"number_barrett_reduce", 1},
 	[ FUNC_NUMBER_INIT_RANDOM_STRICT_RANGE ] =
 	{"number_init_random_strict_range", 1},
 	[ FUNC_NUMBER_EXPONENTIATION ] = {"number_exponentiation", 1},
@@ -258,11 +262,15 @@ func_t func_table[FUNC_COUNT] = {
 	[ FUNC_NUMBER_MONTGOMERY_FACTOR_SET ] = {"number_montgomery_factor_set",
 		1},
 	[ FUNC_NUMBER_MONTGOMERY_PRODUCT] = {"number_montgomery_product", 1},
+	[ FUNC_NUMBER_MONTGOMERY_SQUARE] = {"number_montgomery_square", 1},
 	[ FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY ] =
 	{"number_modular_exponentiation_montgomery", 1},
+	[ FUNC_NUMBER_MODULAR_EXPONENTIATION_MONTGOMERY_BATCH ] =
+	{"number_modular_exponentiation_montgomery_batch", 1},
 	[ FUNC_NUMBER_WITNESS_INIT ] = {"number_witness_init", 1},
 	[ FUNC_NUMBER_WITNESS ] = {"number_witness", 1},
 	[ FUNC_NUMBER_MILLER_RABIN ] = {"number_miller_rabin", 1},
+	[ FUNC_NUMBER_LUCAS ] = {"number_lucas", 1},
 	[ FUNC_NUMBER_IS_PRIME ] = {"number_is_prime", 1},
 	[ FUNC_NUMBER_IS_PRIME1 ] = {"number_is_prime1", 1},
 	[ FUNC_NUMBER_IS_PRIME2 ] = {"number_is_prime2", 1},
@@ -348,6 +356,17 @@ static inline void local_timer_stop(void)
 #endif
 }
 
+static double local_timer_total(void)
+{
+#ifdef TIME_FUNCTIONS
+	return (double)(timer.stop.tv_sec - timer.start.tv_sec) +
+		((double)(timer.stop.tv_usec - timer.start.tv_usec) / 1000000);
+#else
+	return (double)(tv2.tv_sec - tv1.tv_sec) +
+		((double)(tv2.tv_usec - tv1.tv_usec) / 1000000);
+#endif
+}
+
 static void p_local_timer(void)
 {
 	double total_time;
@@ -357,8 +376,7 @@ static void p_local_timer(void)
 	int i;
 	char buf[MAX_IO_BUF];
 
-	total_time = (double)(timer.stop.tv_sec - timer.start.tv_sec) +
-		((double)(timer.stop.tv_usec - timer.start.tv_usec) / 1000000);
+	total_time = local_timer_total();
 	p_comment_nl(fmt, total_time);
 	for (i = 0; i < FUNC_COUNT; i++) {
 		char *ptr = buf;
@@ -384,12 +402,28 @@ static void p_local_timer(void)
 		p_comment_nl("%s", buf);
 	}
 #else
-	total_time = (double)(tv2.tv_sec - tv1.tv_sec) +
-		((double)(tv2.tv_usec - tv1.tv_usec) / 1000000);
+	total_time = local_timer_total();
 	p_comment_nl(fmt, total_time);
 #endif
 }
 
+static void rsa_tests_init(int argc, char *argv[]);
+
+/* run func at each of the supported encryption levels, then restore the level
+ * under test */
+static int test_all_levels(int (*func)(void))
+{
+	int *level, ret = 0;
+
+	for (level = encryption_levels; *level && !ret; level++) {
+		number_enclevl_set(*level);
+		ret = func();
+	}
+
+	rsa_tests_init(0, NULL);
+	return ret;
+}
+
 /* the tests */
 
 static int test001(void)
@@ -868,6 +902,37 @@ static int test029(void)
 	return !(*(u64*)&a == *(u64*)&res);
 }
 
+static int test030(void)
+{
+	u1024_t a, shifted, res;
+	int i, j, n, ret = 0;
+
+	for (i = 0; i < 50 && !ret; i++) {
+		number_init_random(&a, block_sz_u1024);
+		n = (i * 37) % (encryption_level + 2 * bit_sz_u64);
+
+		/* multi bit shifts vs. n single bit shifts */
+		number_assign(shifted, a);
+		number_shift_left(&shifted, n);
+		number_assign(res, a);
+		for (j = 0; j < n; j++)
+			number_shift_left_once(&res);
+		number_top_set(&res);
+		ret = !number_is_equal(&shifted, &res) ||
+			*((u64*)&shifted + block_sz_u1024) !=
+			*((u64*)&res + block_sz_u1024);
+
+		number_assign(shifted, a);
+		number_shift_right(&shifted, n);
+		number_assign(res, a);
+		for (j = 0; j < n; j++)
+			number_shift_right_once(&res);
+		ret |= !number_is_equal(&shifted, &res);
+	}
+	p_comment_nl("%d random multi bit shifts", i);
+	return ret;
+}
+
 static int test031(void)
 {
 	u1024_t a, b, c, res;
@@ -1151,6 +1216,137 @@ static int test035(void)
 	return !number_is_equal(&num_a, &res);
 }
 
+static int test036_level(void)
+{
+#define ITER 1000
+	u1024_t a, b, res_bitwise, res;
+	double time_bitwise, time_word;
+	int i;
+
+	number_init_random(&a, block_sz_u1024/2);
+	number_init_random(&b, block_sz_u1024/2);
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		number_mul_bitwise(&res_bitwise, &a, &b);
+	local_timer_stop();
+	time_bitwise = local_timer_total();
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		number_mul(&res, &a, &b);
+	local_timer_stop();
+	time_word = local_timer_total();
+
+	p_comment_nl("%4d bits: bit serial %.3lg usec, word level %.3lg usec, "
+		"speedup x%.1lf", encryption_level, time_bitwise * M / ITER,
+		time_word * M / ITER, time_word ? time_bitwise / time_word : 0);
+	return !number_is_equal(&res, &res_bitwise);
+#undef ITER
+}
+
+static int test036(void)
+{
+	return test_all_levels(test036_level);
+}
+
+/* the fixed size kernels of a level agree with the generic ones */
+static int test039(void)
+{
+	static number_ctx_t context, context_generic, *ctx = &context,
+		*ctx_generic = &context_generic;
+	u1024_t a, b, n, res, res_generic;
+	int i, ret = 0;
+
+	if (number_ctx_init(ctx, encryption_level, 1) ||
+		number_ctx_init(ctx_generic, encryption_level, 1)) {
+		return -1;
+	}
+	number_kernels_generic_set_r(ctx_generic);
+	p_comment_nl("%s %d limb kernels", ctx->kernels->name,
+		ctx->kernels->block_sz);
+
+	for (i = 0; i < 50 && !ret; i++) {
+		number_init_random_r(ctx, &a, block_sz_u1024 - i % 2);
+		number_init_random_r(ctx, &b, i % block_sz_u1024 + 1);
+		number_init_random_r(ctx, &n, block_sz_u1024);
+		*(u64*)&n.arr |= (u64)1;
+
+		number_add_r(ctx, &res, &a, &b);
+		number_add_r(ctx_generic, &res_generic, &a, &b);
+		ret |= !number_is_equal(&res, &res_generic);
+
+		number_sub_r(ctx, &res, &b, &a);
+		number_sub_r(ctx_generic, &res_generic, &b, &a);
+		ret |= !number_is_equal(&res, &res_generic);
+
+		number_mul_r(ctx, &res, &a, &b);
+		number_mul_r(ctx_generic, &res_generic, &a, &b);
+		ret |= !number_is_equal(&res, &res_generic);
+
+		number_modular_exponentiation_montgomery_r(ctx, &res, &a, &b,
+			&n);
+		number_modular_exponentiation_montgomery_r(ctx_generic,
+			&res_generic, &a, &b, &n);
+		ret |= !number_is_equal(&res, &res_generic);
+	}
+	p_comment_nl("%d random add, sub, mul and montgomery exponentiations",
+		i);
+	return ret;
+}
+
+/* times montgomery exponentiation by the fixed size kernels of each level
+ * against the generic ones */
+static int test040_level(void)
+{
+#define ITER 200
+	static number_ctx_t context, context_generic, *ctx = &context,
+		*ctx_generic = &context_generic;
+	u1024_t a, b, n, res, res_generic;
+	double time_fixed, time_generic;
+	int i;
+
+	if (number_ctx_init(ctx, encryption_level, 1) ||
+		number_ctx_init(ctx_generic, encryption_level, 1)) {
+		return -1;
+	}
+	number_kernels_generic_set_r(ctx_generic);
+	number_init_random_r(ctx, &a, block_sz_u1024 - 1);
+	number_init_random_r(ctx, &b, block_sz_u1024);
+	number_init_random_r(ctx, &n, block_sz_u1024);
+	*(u64*)&n.arr |= (u64)1;
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++) {
+		number_modular_exponentiation_montgomery_r(ctx_generic,
+			&res_generic, &a, &b, &n);
+	}
+	local_timer_stop();
+	time_generic = local_timer_total();
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++) {
+		number_modular_exponentiation_montgomery_r(ctx, &res, &a, &b,
+			&n);
+	}
+	local_timer_stop();
+	time_fixed = local_timer_total();
+
+	p_comment_nl("%4d bits: generic %.3lg usec, %s %d limb kernels "
+		"%.3lg usec, speedup x%.2lf", encryption_level,
+		time_generic * M / ITER, ctx->kernels->name,
+		ctx->kernels->block_sz,
+		time_fixed * M / ITER, time_fixed ? time_generic / time_fixed :
+		0);
+	return !number_is_equal(&res, &res_generic);
+#undef ITER
+}
+
+static int test040(void)
+{
+	return test_all_levels(test040_level);
+}
+
 static int test041(void)
 {
 	u1024_t num_547, num_547_again, num_252;
@@ -1384,6 +1580,73 @@ static int test048(void)
 	return ret;
 }
 
+static int test049(void)
+{
+	u1024_t a, b, sum, diff, res;
+	int i, ret = 0;
+
+	for (i = 0; i < 100 && !ret; i++) {
+		number_init_random(&a, i % block_sz_u1024 + 1);
+		number_init_random(&b, block_sz_u1024 - i % block_sz_u1024);
+
+		/* (a + b) - b = a, (a - b) + b = a mod 2^encryption_level */
+		number_add(&sum, &a, &b);
+		number_sub(&res, &sum, &b);
+		ret = !number_is_equal(&res, &a);
+
+		number_sub(&diff, &a, &b);
+		number_add(&res, &diff, &b);
+		number_reset_buffer(&res);
+		ret |= !number_is_equal(&res, &a);
+
+		/* a - b and b - a are each other's two's complement */
+		number_sub(&res, &b, &a);
+		number_add(&res, &res, &diff);
+		number_reset_buffer(&res);
+		ret |= !number_is_equal(&res, &NUM_0);
+	}
+	p_comment_nl("%d random additions and subtractions", i);
+	return ret;
+}
+
+static int test050(void)
+{
+#define DIVISORS 16
+	u1024_t a, num_d, num_q, num_r;
+	u64 d[DIVISORS], rem[DIVISORS];
+	int i, k, ret = 0;
+
+	for (i = 0; i < 100 && !ret; i++) {
+		number_init_random(&a, block_sz_u1024);
+
+		/* limb divisors: 1, a power of 2, small odd and random ones */
+		d[0] = 1;
+		d[1] = (u64)1 << (i % BIT_SZ_U64);
+		for (k = 2; k < DIVISORS; k++) {
+			number_init_random(&num_d, 1);
+			d[k] = k < 8 ? (u64)(2 * k + 1) :
+				*(u64*)&num_d.arr >> (i % BIT_SZ_U64);
+			if (!d[k])
+				d[k] = 1;
+		}
+
+		number_mod_small_many(rem, &a, d, DIVISORS);
+		for (k = 0; k < DIVISORS; k++) {
+			u64 mod;
+
+			number_small_dec2num(&num_d, d[k]);
+			number_dev(&num_q, &num_r, &a, &num_d);
+			mod = *(u64*)&num_r.arr;
+			ret |= number_mod_small(&a, d[k]) != mod ||
+				rem[k] != mod;
+		}
+	}
+	p_comment_nl("%d random numbers by %d limb divisors each", i,
+		DIVISORS);
+	return ret;
+#undef DIVISORS
+}
+
 static int test051(void)
 {
 	u1024_t a, b, q, r, res_q, res_r;
@@ -1574,6 +1837,97 @@ static int test057(void)
 	return 0;
 }
 
+static int test058(void)
+{
+	u1024_t a, b, q, r, res;
+	int i, ret = 0;
+
+	for (i = 0; i < 100 && !ret; i++) {
+		number_init_random(&a, block_sz_u1024);
+		number_init_random(&b, i % block_sz_u1024 + 1);
+		if (!(i % 3))
+			*((u64*)&b + b.top) |= MSB(u64);
+		number_top_set(&b);
+
+		number_dev(&q, &r, &a, &b);
+		number_mul(&res, &q, &b);
+		number_add(&res, &res, &r);
+		ret = !number_is_equal(&res, &a) || !number_is_greater(&b, &r);
+	}
+	p_comment_nl("a = q*b + r, r < b for %d random divisions", i);
+	return ret;
+}
+
+static int test059_level(void)
+{
+#define ITER 100
+	u1024_t a, b, q, r, q_bitwise, r_bitwise;
+	double time_bitwise, time_knuth;
+	int i;
+
+	number_init_random(&a, block_sz_u1024);
+	number_init_random(&b, block_sz_u1024/2);
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		number_dev_bitwise(&q_bitwise, &r_bitwise, &a, &b);
+	local_timer_stop();
+	time_bitwise = local_timer_total();
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		number_dev(&q, &r, &a, &b);
+	local_timer_stop();
+	time_knuth = local_timer_total();
+
+	p_comment_nl("%4d bits: bit serial %.3lg usec, algorithm D %.3lg usec, "
+		"speedup x%.1lf", encryption_level, time_bitwise * M / ITER,
+		time_knuth * M / ITER, time_knuth ? time_bitwise / time_knuth :
+		0);
+	return !number_is_equal(&q, &q_bitwise) ||
+		!number_is_equal(&r, &r_bitwise);
+#undef ITER
+}
+
+static int test059(void)
+{
+	return test_all_levels(test059_level);
+}
+
+static int test060(void)
+{
+	u1024_t a, b, q, r, r_small, res;
+	int i, is_single = 0, ret = 0;
+
+	for (i = 0; i < 200 && !ret; i++) {
+		u64 q_small;
+
+		/* quotients of a limb, and some larger */
+		number_init_random(&a, block_sz_u1024);
+		number_init_random(&b, block_sz_u1024);
+		number_shift_right(&b, i % (BIT_SZ_U64 + 8));
+		if (!(i % 3))
+			*((u64*)&b + b.top) |= MSB(u64);
+		number_top_set(&b);
+
+		number_dev(&q, &r, &a, &b);
+		number_assign(r_small, a);
+		q_small = number_dev_small(&r_small, &r_small, &b);
+		ret = q_small != *(u64*)&q || !number_is_equal(&r_small, &r);
+		if (q.top > 0)
+			continue;
+
+		/* a = q*b + r, by a single limb q */
+		is_single++;
+		number_assign(res, r);
+		number_mul_small_add(&res, &b, q_small);
+		ret |= !number_is_equal(&res, &a);
+	}
+	p_comment_nl("%d random divisions, %d by a single limb quotient", i,
+		is_single);
+	return ret;
+}
+
 static int test061(void)
 {
 	u1024_t a;
@@ -1666,6 +2020,37 @@ static int test064(void)
 	return !number_is_equal(&num_25, &res);
 }
 
+static int test065(void)
+{
+	barrett_ctx_t barrett;
+	u1024_t n, x, r, res;
+	int i, ret = 0;
+
+	for (i = 0; i < 200 && !ret; i++) {
+		/* moduli of 1 to block_sz_u1024 limbs, some of which leave x
+		 * too long for a barrett reduction */
+		number_init_random(&n, 1 + i % block_sz_u1024);
+		if (number_is_equal(&n, &NUM_0))
+			number_assign(n, NUM_1);
+		number_init_random(&x, block_sz_u1024);
+		if (i % 4 == 1)
+			number_shift_right(&x, (i * 7) % encryption_level);
+		if (i % 4 == 2)
+			number_assign(x, n);
+
+		number_barrett_set(&barrett, &n);
+		number_barrett_reduce(&r, &x, &barrett);
+		number_mod(&res, &x, &n);
+		ret = !number_is_equal(&r, &res);
+
+		/* in place */
+		number_barrett_reduce(&x, &x, &barrett);
+		ret |= !number_is_equal(&x, &res);
+	}
+	p_comment_nl("%d random reductions", i);
+	return ret;
+}
+
 static int test066(void)
 {
 	u1024_t r, a, b, n, res;
@@ -1732,6 +2117,46 @@ static int test069(void)
 	return !number_is_equal(&num_res, &res);
 }
 
+static int test070_level(void)
+{
+#define ITER 1000
+	barrett_ctx_t barrett;
+	u1024_t n, x, r, r_barrett;
+	double time_barrett, time_mod;
+	int i;
+
+	number_init_random(&n, block_sz_u1024 / 2);
+	*((u64*)&n + block_sz_u1024 / 2 - 1) |= MSB(u64);
+	number_top_set(&n);
+	number_init_random(&x, block_sz_u1024);
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		number_mod(&r, &x, &n);
+	local_timer_stop();
+	time_mod = local_timer_total();
+
+	/* the one time division setting mu is part of the cost */
+	local_timer_start();
+	number_barrett_set(&barrett, &n);
+	for (i = 0; i < ITER; i++)
+		number_barrett_reduce(&r_barrett, &x, &barrett);
+	local_timer_stop();
+	time_barrett = local_timer_total();
+
+	p_comment_nl("%4d bits: division %.3lg usec, barrett %.3lg usec, "
+		"speedup x%.1lf", encryption_level, time_mod * M / ITER,
+		time_barrett * M / ITER, time_barrett ? time_mod /
+		time_barrett : 0);
+	return !number_is_equal(&r, &r_barrett);
+#undef ITER
+}
+
+static int test070(void)
+{
+	return test_all_levels(test070_level);
+}
+
 static int test071(void)
 {
 	u1024_t num_n, res, num_montgomery_factor;
@@ -1761,6 +2186,276 @@ static int test072(void)
 	return 0;
 }
 
+static int test073(void)
+{
+#define MODULI_NUM 16
+	u1024_t n[MODULI_NUM], factor[MODULI_NUM], res, num_2, exp;
+	int i, ret = 0;
+
+	number_small_dec2num(&num_2, (u64)2);
+	number_small_dec2num(&exp, (u64)(encryption_level + 2));
+	number_shift_left(&exp, 1);
+
+	/* more moduli than the cache holds, revisited in reverse order */
+	for (i = 0; i < MODULI_NUM; i++) {
+		number_init_random(&n[i], block_sz_u1024/2);
+		*(u64*)&n[i] |= (u64)1;
+		number_montgomery_factor_set(&n[i], NULL);
+		number_montgomery_factor_get(&factor[i]);
+	}
+	for (i = MODULI_NUM - 1; i >= 0 && !ret; i--) {
+		number_montgomery_factor_set(&n[i], NULL);
+		number_montgomery_factor_get(&res);
+		ret = !number_is_equal(&res, &factor[i]);
+
+		number_modular_exponentiation_naive(&res, &num_2, &exp, &n[i]);
+		ret |= !number_is_equal(&res, &factor[i]);
+	}
+	p_comment_nl("%d moduli, montgomery factors %s", MODULI_NUM,
+		ret ? "differ" : "match");
+	return ret;
+#undef MODULI_NUM
+}
+
+/* number contexts at all levels, used interleaved, agree with the number_*()
+ * functions at each level. contexts seeded alike generate the same numbers,
+ * however their use is interleaved with that of other contexts */
+static int test074(void)
+{
+#define ROUNDS 4
+#define LEVELS_MAX 4
+#if defined(ULLONG)
+	int *levels = encryption_levels;
+#else
+	int levels[] = { encryption_level, 0 };
+#endif
+	static number_ctx_t ctx[2][LEVELS_MAX];
+	static u1024_t a[ROUNDS][LEVELS_MAX];
+	static u1024_t e[ROUNDS][LEVELS_MAX];
+	static u1024_t n[ROUNDS][LEVELS_MAX];
+	static u1024_t res[ROUNDS][LEVELS_MAX];
+	u1024_t num_a, num_e, num_n, num_res, num_q, num_r;
+	int i, j, level_num, ret = 0;
+
+	for (level_num = 0; levels[level_num] && level_num < LEVELS_MAX;
+		level_num++) {
+		if (number_ctx_init(&ctx[0][level_num], levels[level_num],
+			level_num + 1) || number_ctx_init(&ctx[1][level_num],
+			levels[level_num], level_num + 1)) {
+			return -1;
+		}
+	}
+
+	/* rounds over ascending levels, with the first set of contexts */
+	for (i = 0; i < ROUNDS; i++) {
+		for (j = 0; j < level_num; j++) {
+			number_ctx_t *c = &ctx[0][j];
+
+			number_init_random_r(c, &n[i][j], c->block_sz);
+			*(u64*)&n[i][j] |= (u64)1;
+			number_init_random_r(c, &a[i][j], c->block_sz);
+			number_mod_r(c, &a[i][j], &a[i][j], &n[i][j]);
+			number_init_random_r(c, &e[i][j], c->block_sz);
+			number_modular_exponentiation_montgomery_r(c,
+				&res[i][j], &a[i][j], &e[i][j], &n[i][j]);
+		}
+	}
+
+	/* descending levels, round by round, with the second set of contexts
+	 * and against the number_*() functions */
+	for (j = level_num - 1; j >= 0 && !ret; j--) {
+		number_ctx_t *c = &ctx[1][j];
+
+#if defined(ULLONG)
+		number_enclevl_set(levels[j]);
+#endif
+		for (i = 0; i < ROUNDS && !ret; i++) {
+			/* a draw from the global generator in between */
+			number_init_random(&num_a, block_sz_u1024);
+			number_init_random_r(c, &num_n, c->block_sz);
+			*(u64*)&num_n |= (u64)1;
+			number_init_random_r(c, &num_a, c->block_sz);
+			number_mod_r(c, &num_a, &num_a, &num_n);
+			number_init_random_r(c, &num_e, c->block_sz);
+			ret = !number_is_equal(&num_n, &n[i][j]) ||
+				!number_is_equal(&num_a, &a[i][j]) ||
+				!number_is_equal(&num_e, &e[i][j]);
+
+			number_modular_exponentiation_montgomery(&num_res,
+				&num_a, &num_e, &num_n);
+			ret |= !number_is_equal(&num_res, &res[i][j]);
+
+			/* n = q*a + r */
+			number_dev_r(c, &num_q, &num_r, &num_n, &num_a);
+			number_mul(&num_res, &num_q, &num_a);
+			number_add(&num_res, &num_res, &num_r);
+			ret |= !number_is_equal(&num_res, &num_n);
+		}
+	}
+
+	rsa_tests_init(0, NULL);
+	p_comment_nl("%d levels, %d rounds each, %s", level_num, ROUNDS,
+		ret ? "results differ" : "results match");
+	return ret;
+#undef LEVELS_MAX
+#undef ROUNDS
+}
+
+/* the work of a test122() thread, at a level by a context of its own: a prime,
+ * which exercises number_generate_coprime_r(), and an exponentiation modulo
+ * it */
+typedef struct {
+	number_ctx_t ctx;
+	u1024_t prime;
+	u1024_t res;
+	pthread_t thread;
+	int is_thread;
+} test122_job_t;
+
+static void *test122_job(void *arg)
+{
+	test122_job_t *job = (test122_job_t *)arg;
+	number_ctx_t *c = &job->ctx;
+	u1024_t num_a, num_e;
+
+	number_find_prime_r(c, &job->prime);
+	number_init_random_r(c, &num_a, c->block_sz);
+	number_mod_r(c, &num_a, &num_a, &job->prime);
+	number_init_random_r(c, &num_e, c->block_sz);
+	number_modular_exponentiation_montgomery_r(c, &job->res, &num_a,
+		&num_e, &job->prime);
+	return NULL;
+}
+
+/* number contexts at all levels, used concurrently by a thread each, agree
+ * with contexts seeded alike and used one after the other */
+static int test122(void)
+{
+#define THREADS 8
+#if defined(ULLONG)
+	int *levels = encryption_levels;
+#else
+	int levels[] = { encryption_level, 0 };
+#endif
+	static test122_job_t serial[THREADS], concurrent[THREADS];
+	int i, jobs, ret = 0;
+
+	for (jobs = 0; levels[jobs / 2] && jobs < THREADS; jobs++) {
+		if (number_ctx_init(&serial[jobs].ctx, levels[jobs / 2],
+			jobs + 1) || number_ctx_init(&concurrent[jobs].ctx,
+			levels[jobs / 2], jobs + 1)) {
+			return -1;
+		}
+	}
+
+	for (i = 0; i < jobs; i++)
+		test122_job(&serial[i]);
+
+	for (i = 0; i < jobs; i++) {
+		concurrent[i].is_thread = !pthread_create(
+			&concurrent[i].thread, NULL, test122_job,
+			&concurrent[i]);
+	}
+	for (i = 0; i < jobs; i++) {
+		if (concurrent[i].is_thread)
+			pthread_join(concurrent[i].thread, NULL);
+		else
+			test122_job(&concurrent[i]);
+	}
+
+	for (i = 0; i < jobs; i++) {
+		ret |= !number_is_equal(&serial[i].prime,
+			&concurrent[i].prime) ||
+			!number_is_equal(&serial[i].res, &concurrent[i].res);
+	}
+
+	p_comment_nl("%d contexts, %s", jobs, ret ? "results differ" :
+		"results match");
+	return ret;
+#undef THREADS
+}
+
+/* the contexts of key generation's prime searches, two at each level, drawn
+ * from the global generator as by rsa_keygen(), are seeded apart and find
+ * different primes p1 and p2 */
+static int test123(void)
+{
+#define JOBS_MAX 8
+#if defined(ULLONG)
+	int *levels = encryption_levels;
+#else
+	int levels[] = { encryption_level, 0 };
+#endif
+	static number_ctx_t ctx[JOBS_MAX];
+	u1024_t p1, p2;
+	int i, j, jobs, ret = 0;
+
+	for (jobs = 0; levels[jobs / 2] && jobs < JOBS_MAX; jobs++) {
+		if (number_ctx_child_init(&ctx[jobs], levels[jobs / 2]))
+			return -1;
+	}
+
+	for (i = 0; i < jobs; i++) {
+		for (j = 0; j < i; j++)
+			ret |= ctx[i].prng_seed == ctx[j].prng_seed;
+	}
+	for (i = 0; i < jobs; i += 2) {
+		number_find_prime_r(&ctx[i], &p1);
+		number_find_prime_r(&ctx[i + 1], &p2);
+		ret |= number_is_equal(&p1, &p2);
+	}
+
+	p_comment_nl("%d contexts, %s", jobs, ret ? "seeds or primes repeat" :
+		"seeds and primes differ");
+	return ret;
+#undef JOBS_MAX
+}
+
+static int test075_level(void)
+{
+#define MODULI_NUM 64
+	static u1024_t n[MODULI_NUM], factor_shift[MODULI_NUM];
+	u1024_t factor;
+	double time_shift, time_dev;
+	int i, ret = 0;
+
+	for (i = 0; i < MODULI_NUM; i++) {
+		number_init_random(&n[i], block_sz_u1024);
+		*(u64*)&n[i] |= (u64)1;
+	}
+
+	local_timer_start();
+	for (i = 0; i < MODULI_NUM; i++)
+		number_montgomery_factor_shift(&factor_shift[i], &n[i]);
+	local_timer_stop();
+	time_shift = local_timer_total();
+
+	/* each modulus is new to the montgomery context cache */
+	local_timer_start();
+	for (i = 0; i < MODULI_NUM; i++)
+		number_montgomery_factor_set(&n[i], NULL);
+	local_timer_stop();
+	time_dev = local_timer_total();
+
+	for (i = 0; i < MODULI_NUM && !ret; i++) {
+		number_montgomery_factor_set(&n[i], NULL);
+		number_montgomery_factor_get(&factor);
+		ret = !number_is_equal(&factor, &factor_shift[i]);
+	}
+
+	p_comment_nl("%4d bits: shift and subtract %.3lg usec, long division "
+		"(context set up) %.3lg usec, speedup x%.1lf", encryption_level,
+		time_shift * M / MODULI_NUM, time_dev * M / MODULI_NUM,
+		time_dev ? time_shift / time_dev : 0);
+	return ret;
+#undef MODULI_NUM
+}
+
+static int test075(void)
+{
+	return test_all_levels(test075_level);
+}
+
 static int test076(void)
 {
 	u1024_t num_4, num_5, num_8, num_9, res;
@@ -1788,6 +2483,146 @@ static int test077(void)
 	return !number_is_equal(&num_45, &res);
 }
 
+static int test078(void)
+{
+	u1024_t a, b, n, res_naive, res_montgomery;
+	int i, ret = 0;
+
+	for (i = 0; i < 20 && !ret; i++) {
+		/* a*b must fit in block_sz_u1024 u64s for the naive method */
+		number_init_random(&a, block_sz_u1024/2);
+		number_init_random(&b, block_sz_u1024/2);
+		number_init_random(&n, block_sz_u1024);
+		*(u64*)&n |= (u64)1;
+
+		number_modular_multiplication_naive(&res_naive, &a, &b, &n);
+		number_modular_multiplication_montgomery(&res_montgomery, &a,
+			&b, &n);
+		ret = !number_is_equal(&res_naive, &res_montgomery);
+
+		/* squaring */
+		number_modular_multiplication_naive(&res_naive, &a, &a, &n);
+		number_modular_multiplication_montgomery(&res_montgomery, &a,
+			&a, &n);
+		ret |= !number_is_equal(&res_naive, &res_montgomery);
+	}
+	p_comment_nl("%d random products and squares modulo random odd "
+		"numbers", i);
+	return ret;
+}
+
+/* batch exponentiation by every engine the cpu supports agrees with
+ * number_modular_exponentiation_montgomery_r(), for batches of any size */
+static int test079(void)
+{
+#define BATCH_SZ 17
+	static number_ctx_t context, *ctx = &context;
+	char *engines[] = { "avx-512 ifma", "scalar" };
+	u1024_t a[BATCH_SZ], res[BATCH_SZ], res_scalar[BATCH_SZ], b, n;
+	int i, k, count, ret = 0;
+
+	if (number_ctx_init(ctx, encryption_level, 1))
+		return -1;
+
+	for (i = 0; i < ARRAY_SZ(engines) && !ret; i++) {
+		if (number_batch_set_r(ctx, engines[i])) {
+			p_comment_nl("%s: not supported", engines[i]);
+			continue;
+		}
+
+		for (count = 1; count <= BATCH_SZ && !ret; count += 4) {
+			number_init_random_r(ctx, &n, block_sz_u1024);
+			*(u64*)&n.arr |= (u64)1;
+			number_init_random_r(ctx, &b, count % block_sz_u1024 +
+				1);
+			for (k = 0; k < count; k++) {
+				number_init_random_r(ctx, &a[k],
+					block_sz_u1024 - k % 2);
+				number_modular_exponentiation_montgomery_r(ctx,
+					&res_scalar[k], &a[k], &b, &n);
+			}
+			/* 0 and 1 are exponentiated as any other block */
+			number_small_dec2num_r(ctx, &a[0], count % 2);
+
+			number_modular_exponentiation_montgomery_r(ctx,
+				&res_scalar[0], &a[0], &b, &n);
+			number_modular_exponentiation_montgomery_batch_r(ctx,
+				res, a, count, &b, &n);
+			for (k = 0; k < count; k++) {
+				ret |= !number_is_equal(&res[k],
+					&res_scalar[k]);
+			}
+
+			/* in place */
+			number_modular_exponentiation_montgomery_batch_r(ctx,
+				a, a, count, &b, &n);
+			for (k = 0; k < count; k++)
+				ret |= !number_is_equal(&a[k], &res_scalar[k]);
+		}
+		p_comment_nl("%s: %d lanes, batches of 1 to %d blocks",
+			engines[i], ctx->batch->lanes, BATCH_SZ);
+	}
+	return ret;
+#undef BATCH_SZ
+}
+
+/* times batch exponentiation by every engine the cpu supports, at each
+ * level */
+static int test080_level(void)
+{
+#define BATCH_SZ 64
+	static number_ctx_t context, *ctx = &context;
+	static u1024_t a[BATCH_SZ], res[BATCH_SZ];
+	char *engines[] = { "scalar", "avx-512 ifma" };
+	double time_serial;
+	u1024_t b, n;
+	int i, k;
+
+	if (number_ctx_init(ctx, encryption_level, 1))
+		return -1;
+	number_init_random_r(ctx, &n, block_sz_u1024);
+	*(u64*)&n.arr |= (u64)1;
+	number_init_random_r(ctx, &b, block_sz_u1024);
+	for (k = 0; k < BATCH_SZ; k++)
+		number_init_random_r(ctx, &a[k], block_sz_u1024 - 1);
+
+	/* one block at a time */
+	local_timer_start();
+	for (k = 0; k < BATCH_SZ; k++) {
+		number_modular_exponentiation_montgomery_r(ctx, &res[k], &a[k],
+			&b, &n);
+	}
+	local_timer_stop();
+	time_serial = local_timer_total();
+	p_comment_nl("%4d bits: serial %.3lg usec per block",
+		encryption_level, time_serial * M / BATCH_SZ);
+
+	for (i = 0; i < ARRAY_SZ(engines); i++) {
+		double time_batch;
+
+		if (number_batch_set_r(ctx, engines[i]))
+			continue;
+
+		local_timer_start();
+		number_modular_exponentiation_montgomery_batch_r(ctx, res, a,
+			BATCH_SZ, &b, &n);
+		local_timer_stop();
+		time_batch = local_timer_total();
+
+		p_comment_nl("%4d bits: %s %.3lg usec per block, speedup "
+			"x%.2lf", encryption_level, engines[i],
+			time_batch * M / BATCH_SZ, time_batch ? time_serial /
+			time_batch : 0);
+	}
+	return 0;
+#undef BATCH_SZ
+}
+
+static int test080(void)
+{
+	return test_all_levels(test080_level);
+}
+
 static int test081(void)
 {
 	u1024_t num_4, num_7, num_5, num_9, res;
@@ -1933,13 +2768,137 @@ static int test087(void)
 	return !number_is_equal(&res, &pow);
 }
 
-static int test091(void)
+static int test088(void)
 {
-	u1024_t a, n;
-
-	if (number_dec2bin(&a, "2") || number_dec2bin(&n, "5")) {
-		printf("initializing a, n failed\n");
-		return -1;
+	u1024_t a, b, n, res_naive, res_montgomery;
+	int i, ret = 0;
+
+	for (i = 0; i < 20 && !ret; i++) {
+		/* squares must fit in block_sz_u1024 u64s for the naive method */
+		number_init_random(&n, block_sz_u1024/2);
+		*(u64*)&n |= (u64)1;
+		number_init_random(&a, block_sz_u1024/2);
+		number_mod(&a, &a, &n);
+
+		/* exponents of all lengths, down to a single bit */
+		number_init_random(&b, block_sz_u1024);
+		number_shift_right(&b, (i * 53) % encryption_level);
+
+		number_modular_exponentiation_naive(&res_naive, &a, &b, &n);
+		number_modular_exponentiation_montgomery(&res_montgomery, &a,
+			&b, &n);
+		ret = !number_is_equal(&res_naive, &res_montgomery);
+	}
+	p_comment_nl("%d random exponentiations", i);
+	return ret;
+}
+
+/* exponentiation replaying the schedule set by
+ * number_exponent_schedule_set_r() vs. one recoding the exponent per call */
+static int test089(void)
+{
+#define BATCH_SZ 5
+	static number_ctx_t context, *ctx = &context;
+	u1024_t a[BATCH_SZ], res[BATCH_SZ], res_recoded[BATCH_SZ], b, n;
+	int i, k, ret = 0;
+
+	if (number_ctx_init(ctx, encryption_level, 1))
+		return -1;
+
+	for (i = 0; i < 40 && !ret; i++) {
+		number_init_random_r(ctx, &n, block_sz_u1024);
+		*(u64*)&n.arr |= (u64)1;
+
+		/* exponents of all lengths, and 0 to 3 */
+		number_init_random_r(ctx, &b, block_sz_u1024);
+		number_shift_right_r(ctx, &b, (i * 53) % encryption_level);
+		if (!(i % 10))
+			number_small_dec2num_r(ctx, &b, (u64)(i / 10));
+		for (k = 0; k < BATCH_SZ; k++) {
+			number_init_random_r(ctx, &a[k], block_sz_u1024 - 1);
+			number_modular_exponentiation_montgomery_r(ctx,
+				&res_recoded[k], &a[k], &b, &n);
+		}
+
+		number_exponent_schedule_set_r(ctx, &b);
+		for (k = 0; k < BATCH_SZ; k++) {
+			number_modular_exponentiation_montgomery_r(ctx, &res[k],
+				&a[k], &b, &n);
+			ret |= !number_is_equal(&res[k], &res_recoded[k]);
+		}
+		number_modular_exponentiation_montgomery_batch_r(ctx, res, a,
+			BATCH_SZ, &b, &n);
+		for (k = 0; k < BATCH_SZ; k++)
+			ret |= !number_is_equal(&res[k], &res_recoded[k]);
+	}
+	p_comment_nl("%d exponents", i);
+	return ret;
+#undef BATCH_SZ
+}
+
+static int test090(void)
+{
+	u1024_t a, b, g, x, y, gcd, ax, by, n, inv, res;
+	int i, invertible = 0, ret = 0;
+
+	for (i = 0; i < 100 && !ret; i++) {
+		/* ax + by == gcd(a, b), modulo 2^encryption_level, for a and b
+		 * of a common limb factor g, on odd runs */
+		number_init_random(&a, block_sz_u1024 - 1);
+		number_init_random(&b, i % (block_sz_u1024 - 1) + 1);
+		number_init_random(&g, 1);
+		if (!(i % 2) || number_is_equal(&g, &NUM_0))
+			number_assign(g, NUM_1);
+		number_mul(&a, &a, &g);
+		number_mul(&b, &b, &g);
+
+		number_extended_euclid_gcd(&gcd, &x, &a, &y, &b);
+		number_mul(&ax, &a, &x);
+		number_mul(&by, &b, &y);
+		number_add(&res, &ax, &by);
+		number_reset_buffer(&res);
+		ret = !number_is_equal(&res, &gcd);
+
+		number_mod(&res, &a, &gcd);
+		ret |= !number_is_equal(&res, &NUM_0);
+		number_mod(&res, &b, &gcd);
+		ret |= !number_is_equal(&res, &NUM_0);
+		number_mod(&res, &gcd, &g);
+		ret |= !number_is_equal(&res, &NUM_0);
+
+		/* inverses modulo odd and even moduli, such as phi */
+		number_init_random(&n, block_sz_u1024 / 2);
+		*(u64*)&n.arr = i % 2 ? *(u64*)&n.arr | 1 : *(u64*)&n.arr & ~1;
+		number_init_random(&a, block_sz_u1024 / 2);
+		number_mod(&a, &a, &n);
+		if (!number_is_greater(&n, &NUM_1) ||
+			number_is_equal(&a, &NUM_0)) {
+			continue;
+		}
+
+		number_extended_euclid_gcd(&gcd, &x, &n, &y, &a);
+		if (number_modular_multiplicative_inverse(&inv, &a, &n)) {
+			ret |= number_is_equal(&gcd, &NUM_1);
+			continue;
+		}
+		number_mul(&res, &a, &inv);
+		number_mod(&res, &res, &n);
+		ret |= !number_is_equal(&gcd, &NUM_1) ||
+			!number_is_equal(&res, &NUM_1) ||
+			!number_is_greater(&n, &inv);
+		invertible++;
+	}
+	p_comment_nl("%d random gcds, %d random inverses", i, invertible);
+	return ret;
+}
+
+static int test091(void)
+{
+	u1024_t a, n;
+
+	if (number_dec2bin(&a, "2") || number_dec2bin(&n, "5")) {
+		printf("initializing a, n failed\n");
+		return -1;
 	}
 
 	return number_witness(&a, &n);
@@ -2114,6 +3073,450 @@ static int test102(void)
 	return is_prime;
 }
 
+/* composites passing the base 2 test or some of the miller-rabin rounds: the
+ * carmichael number 561, 2047 and 3215031751, strong pseudoprimes to the bases
+ * up to 2 and 7, and 3825123056546413051, one to all the bases up to 23 */
+static int test105(void)
+{
+	char *composites[] = { "561", "2047", "3215031751",
+		"3825123056546413051" };
+	u1024_t num_n;
+	int i, ret = 0;
+
+	for (i = 0; i < ARRAY_SZ(composites); i++) {
+		number_dec2bin(&num_n, composites[i]);
+		if (number_is_prime(&num_n)) {
+			p_comment_nl("%s is prime", composites[i]);
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+/* number_is_prime() per sieved composite candidate, against a single
+ * miller-rabin round by a random base, and per prime, at each level */
+static int test111_level(void)
+{
+#define ITER 64
+#define ITER_PRIMES 32
+	static u1024_t composites[ITER], primes[ITER_PRIMES];
+	u1024_t num_inc, num_a;
+	double time_base2, time_random, time_prime, time_prime_old;
+	int i, k, ret = 0;
+
+	for (i = 0; i < ITER; i++) {
+		do {
+			number_generate_coprime(&composites[i], &num_inc);
+		} while (number_is_prime(&composites[i]));
+	}
+	for (i = 0; i < ITER_PRIMES; i++)
+		number_find_prime(&primes[i]);
+	number_init_random(&num_a, block_sz_u1024 / 2);
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		ret |= number_is_prime(&composites[i]);
+	local_timer_stop();
+	time_base2 = local_timer_total();
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		number_witness(&num_a, &composites[i]);
+	local_timer_stop();
+	time_random = local_timer_total();
+
+	local_timer_start();
+	for (i = 0; i < ITER_PRIMES; i++)
+		ret |= !number_is_prime(&primes[i]);
+	local_timer_stop();
+	time_prime = local_timer_total();
+
+	/* as confirmed before the base 2 test, by 9 random base rounds */
+	local_timer_start();
+	for (i = 0; i < ITER_PRIMES; i++) {
+		for (k = 0; k < 9; k++) {
+			number_init_random(&num_a, block_sz_u1024 / 2);
+			ret |= number_witness(&num_a, &primes[i]);
+		}
+	}
+	local_timer_stop();
+	time_prime_old = local_timer_total();
+
+	p_comment_nl("%4d bits: composite rejected %.3lg usec (random base "
+		"round %.3lg usec, x%.1lf), prime confirmed %.3lg msec (9 "
+		"random base rounds %.3lg msec, x%.1lf)", encryption_level,
+		time_base2 * M / ITER, time_random * M / ITER,
+		time_base2 ? time_random / time_base2 : 0,
+		time_prime * K / ITER_PRIMES, time_prime_old * K / ITER_PRIMES,
+		time_prime ? time_prime_old / time_prime : 0);
+	return ret;
+#undef ITER_PRIMES
+#undef ITER
+}
+
+static int test111(void)
+{
+	return test_all_levels(test111_level);
+}
+
+/* number_is_prime() by baillie-psw agrees with trial division up to 10000, and
+ * rejects the composites of test105 as well as 1194649 and 12327121, the
+ * squares of the wieferich primes, which are strong pseudoprimes to base 2 */
+static int test113(void)
+{
+	static number_ctx_t context, *ctx = &context;
+	char *composites[] = { "561", "2047", "1194649", "12327121",
+		"3215031751", "3825123056546413051" };
+	char str_num[6];
+	u1024_t num_n;
+	int i, d, is_prime;
+
+	if (number_ctx_init(ctx, encryption_level, 1))
+		return -1;
+	number_prime_test_set_r(ctx, NUMBER_PRIME_TEST_BPSW);
+
+	for (i = 3; i < 10000; i++) {
+		for (d = 2; d * d <= i && i % d; d++);
+		is_prime = d * d > i;
+
+		sprintf(str_num, "%d", i);
+		number_dec2bin(&num_n, str_num);
+		if (number_is_prime_r(ctx, &num_n) != is_prime) {
+			p_comment_nl("%d is %sprime and was found to be "
+				"%sprime", i, is_prime ? "" : "non ",
+				is_prime ? "non " : "");
+			return -1;
+		}
+	}
+
+	for (i = 0; i < ARRAY_SZ(composites); i++) {
+		number_dec2bin(&num_n, composites[i]);
+		if (number_is_prime_r(ctx, &num_n)) {
+			p_comment_nl("%s is prime", composites[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* strong lucas pseudoprimes, with selfridge's parameters, pass
+ * number_lucas_r() but not the base 2 test of number_is_prime() */
+static int test114(void)
+{
+	static number_ctx_t context, *ctx = &context;
+	char *pseudoprimes[] = { "5459", "5777", "10877", "16109", "18971" };
+	u1024_t num_n;
+	int i;
+
+	if (number_ctx_init(ctx, encryption_level, 1))
+		return -1;
+	number_prime_test_set_r(ctx, NUMBER_PRIME_TEST_BPSW);
+
+	for (i = 0; i < ARRAY_SZ(pseudoprimes); i++) {
+		number_dec2bin(&num_n, pseudoprimes[i]);
+		number_montgomery_factor_set_r(ctx, &num_n, NULL);
+		if (!number_lucas_r(ctx, &num_n) ||
+			number_is_prime_r(ctx, &num_n)) {
+			p_comment_nl("%s is not a strong lucas pseudoprime",
+				pseudoprimes[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* number_is_prime() per confirmed prime, by miller-rabin and by baillie-psw,
+ * at each level */
+static int test115_level(void)
+{
+#define ITER 16
+	static u1024_t primes[ITER];
+	double time_mr, time_bpsw;
+	int i, ret = 0;
+
+	for (i = 0; i < ITER; i++)
+		number_find_prime(&primes[i]);
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		ret |= !number_is_prime(&primes[i]);
+	local_timer_stop();
+	time_mr = local_timer_total();
+
+	number_prime_test_set(NUMBER_PRIME_TEST_BPSW);
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		ret |= !number_is_prime(&primes[i]);
+	local_timer_stop();
+	time_bpsw = local_timer_total();
+	number_prime_test_set(NUMBER_PRIME_TEST_MILLER_RABIN);
+
+	p_comment_nl("%4d bits: miller-rabin %.3lg msec, baillie-psw %.3lg "
+		"msec per prime, speedup x%.1lf", encryption_level,
+		time_mr * K / ITER, time_bpsw * K / ITER, time_bpsw ?
+		time_mr / time_bpsw : 0);
+	return ret;
+#undef ITER
+}
+
+static int test115(void)
+{
+	return test_all_levels(test115_level);
+}
+
+/* number_find_prime_parallel_r() finds the prime of number_find_prime_r() from
+ * the same seed, whatever the number of threads and their timing */
+static int test119(void)
+{
+#define ROUNDS 4
+	static number_ctx_t context, *ctx = &context;
+	int threads[] = { 2, 3, 8 };
+	u1024_t num_prime, num_parallel;
+	int i, j;
+
+	for (i = 0; i < ROUNDS; i++) {
+		if (number_ctx_init(ctx, encryption_level, i + 1))
+			return -1;
+		number_find_prime_r(ctx, &num_prime);
+
+		for (j = 0; j < ARRAY_SZ(threads); j++) {
+			number_ctx_init(ctx, encryption_level, i + 1);
+			number_find_prime_parallel_r(ctx, &num_parallel,
+				threads[j]);
+			if (!number_is_equal(&num_parallel, &num_prime)) {
+				p_comment_nl("seed %d, %d threads: a different "
+					"prime was found", i + 1, threads[j]);
+				return -1;
+			}
+		}
+	}
+	return 0;
+#undef ROUNDS
+}
+
+/* a prime search of test124(), by threads workers of its own */
+typedef struct {
+	number_ctx_t ctx;
+	u1024_t prime;
+	int threads;
+	pthread_t thread;
+	int is_thread;
+} test124_job_t;
+
+static void *test124_job(void *arg)
+{
+	test124_job_t *job = (test124_job_t *)arg;
+
+	number_find_prime_parallel_r(&job->ctx, &job->prime, job->threads);
+	return NULL;
+}
+
+/* parallel prime searches at all levels, run concurrently by a thread each as
+ * by rsa_keygen(), find primes, and the very ones number_find_prime_r() finds
+ * from equally seeded contexts */
+static int test124(void)
+{
+#define JOBS_MAX 8
+#if defined(ULLONG)
+	int *levels = encryption_levels;
+#else
+	int levels[] = { encryption_level, 0 };
+#endif
+	static test124_job_t serial[JOBS_MAX], concurrent[JOBS_MAX];
+	int threads[] = { 2, 4 };
+	int i, t, jobs, ret = 0;
+
+	for (t = 0; t < ARRAY_SZ(threads); t++) {
+		for (jobs = 0; levels[jobs / 2] && jobs < JOBS_MAX; jobs++) {
+			if (number_ctx_init(&serial[jobs].ctx,
+				levels[jobs / 2], jobs + 1) ||
+				number_ctx_init(&concurrent[jobs].ctx,
+				levels[jobs / 2], jobs + 1)) {
+				return -1;
+			}
+			concurrent[jobs].threads = threads[t];
+		}
+
+		for (i = 0; i < jobs; i++)
+			number_find_prime_r(&serial[i].ctx, &serial[i].prime);
+
+		for (i = 0; i < jobs; i++) {
+			concurrent[i].is_thread = !pthread_create(
+				&concurrent[i].thread, NULL, test124_job,
+				&concurrent[i]);
+		}
+		for (i = 0; i < jobs; i++) {
+			if (concurrent[i].is_thread)
+				pthread_join(concurrent[i].thread, NULL);
+			else
+				test124_job(&concurrent[i]);
+		}
+
+		for (i = 0; i < jobs; i++) {
+			if (!number_is_prime_r(&serial[i].ctx,
+				&concurrent[i].prime)) {
+				p_comment_nl("%d threads, level %d: not a "
+					"prime", threads[t], levels[i / 2]);
+				ret = -1;
+			} else if (!number_is_equal(&concurrent[i].prime,
+				&serial[i].prime)) {
+				p_comment_nl("%d threads, level %d: a "
+					"different prime was found",
+					threads[t], levels[i / 2]);
+				ret = -1;
+			}
+		}
+	}
+	return ret;
+#undef JOBS_MAX
+}
+
+/* number_find_prime_parallel() scaling over 1 (number_find_prime()), 2, 4 and
+ * 8 threads, at each level */
+static int test121_level(void)
+{
+#define ITER 16
+	static number_ctx_t context, *ctx = &context;
+	static u1024_t primes[ITER];
+	int threads[] = { 1, 2, 4, 8 };
+	int i, t, processors = (int)sysconf(_SC_NPROCESSORS_ONLN), ret = 0;
+	double time[ARRAY_SZ(threads)];
+	u1024_t num_p, num_inc;
+
+	for (t = 0; t < ARRAY_SZ(threads); t++) {
+		time[t] = 0;
+		for (i = 0; i < ITER; i++) {
+			/* equally seeded, every thread count searches from the
+			 * same start, and so finds the same prime. the first
+			 * starting point, which initiates the coprime tables,
+			 * is untimed */
+			if (number_ctx_init(ctx, encryption_level, i + 1))
+				return -1;
+			number_generate_coprime_r(ctx, &num_p, &num_inc);
+
+			local_timer_start();
+			number_find_prime_parallel_r(ctx, &num_p, threads[t]);
+			local_timer_stop();
+			time[t] += local_timer_total();
+
+			if (!t)
+				number_assign(primes[i], num_p);
+			else
+				ret |= !number_is_equal(&num_p, &primes[i]);
+		}
+
+		p_comment_nl("%4d bits: %d thread%s %.3lg msec per prime, "
+			"speedup x%.1lf (%d processor%s)", encryption_level,
+			threads[t], threads[t] == 1 ? "" : "s",
+			time[t] * K / ITER, time[t] ? time[0] / time[t] : 0,
+			processors, processors == 1 ? "" : "s");
+	}
+
+	for (i = 0; i < ITER; i++)
+		ret |= !number_is_prime(&primes[i]);
+	return ret;
+#undef ITER
+}
+
+static int test121(void)
+{
+	return test_all_levels(test121_level);
+}
+
+/* the e and d stage of key generation, for a random phi at each level */
+static int test103_level(void)
+{
+#define ITER 20
+	static u1024_t e[ITER];
+	u1024_t phi, d;
+	double time_e, time_d;
+	int i, ret = 0;
+
+	number_init_random(&phi, block_sz_u1024);
+	*(u64*)&phi.arr &= ~(u64)1;
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		number_init_random_coprime(&e[i], &phi);
+	local_timer_stop();
+	time_e = local_timer_total();
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++)
+		ret |= number_modular_multiplicative_inverse(&d, &e[i], &phi);
+	local_timer_stop();
+	time_d = local_timer_total();
+
+	p_comment_nl("%4d bits: co prime e %.3lg usec, inverse d %.3lg usec",
+		encryption_level, time_e * M / ITER, time_d * M / ITER);
+	return ret;
+#undef ITER
+}
+
+static int test103(void)
+{
+	return test_all_levels(test103_level);
+}
+
+/* number_find_prime() against its candidates being tested by miller-rabin
+ * alone, at each level */
+static int test104_level(void)
+{
+#define ITER 64
+	static number_ctx_t contexts[2], *ctx_mr = &contexts[0],
+		*ctx_sieved = &contexts[1];
+	static u1024_t primes[ITER];
+	u1024_t num_p, num_inc;
+	double time_sieved, time_mr;
+	u64 d;
+	int i, ret = 0;
+
+	/* equally seeded, both searches walk the same candidates */
+	if (number_ctx_init(ctx_mr, encryption_level, 1) ||
+		number_ctx_init(ctx_sieved, encryption_level, 1)) {
+		return -1;
+	}
+	/* untimed, the first search initiates the coprime tables */
+	number_find_prime_r(ctx_mr, &num_p);
+	number_find_prime_r(ctx_sieved, &num_p);
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++) {
+		number_generate_coprime_r(ctx_mr, &num_p, &num_inc);
+		while (!number_is_prime_r(ctx_mr, &num_p))
+			number_add_r(ctx_mr, &num_p, &num_p, &num_inc);
+		number_assign(primes[i], num_p);
+	}
+	local_timer_stop();
+	time_mr = local_timer_total();
+
+	local_timer_start();
+	for (i = 0; i < ITER; i++) {
+		number_find_prime_r(ctx_sieved, &num_p);
+		ret |= !number_is_equal(&num_p, &primes[i]);
+	}
+	local_timer_stop();
+	time_sieved = local_timer_total();
+
+	for (i = 0; i < ITER; i++) {
+		for (d = 3; d < 2000; d += 2)
+			ret |= !number_mod_small(&primes[i], d);
+		ret |= !number_is_prime(&primes[i]);
+	}
+
+	p_comment_nl("%4d bits: miller-rabin only %.3lg msec, sieved %.3lg "
+		"msec per prime, speedup x%.1lf", encryption_level,
+		time_mr * K / ITER, time_sieved * K / ITER, time_sieved ?
+		time_mr / time_sieved : 0);
+	return ret;
+#undef ITER
+}
+
+static int test104(void)
+{
+	return test_all_levels(test104_level);
+}
+
 static int test106(void)
 {
 #define NUM_P "num_p"
@@ -2832,6 +4235,11 @@ static test_t rsa_tests[] = {
 		func: test029,
 		disabled: DISABLE_USHORT | DISABLE_UINT | DISABLE_ULLONG,
 	},
+	{
+		description: "number_shift_left() and number_shift_right() - "
+			"multi bit shifts, random numbers",
+		func: test030,
+	},
 	/* number multiplication */
 	{
 		description: "number_mul() - multiplicand > multiplier",
@@ -2863,6 +4271,28 @@ static test_t rsa_tests[] = {
 		DISABLE_ULLONG_64 | DISABLE_ULLONG_128 | DISABLE_ULLONG_256 |
 		DISABLE_ULLONG_512,
 	},
+	{
+		description: "number_mul() - word level vs. bit serial "
+			"benchmark (all levels)",
+		func: test036,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
+	{
+		description: "number_*_r() - fixed size vs. generic kernels",
+		func: test039,
+	},
+	{
+		description: "number_modular_exponentiation_montgomery_r() - "
+			"fixed size kernels benchmark (all levels)",
+		func: test040,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
 	/* number subtraction */
 	{
 		description: "number_is_greater() and number_is_equal()",
@@ -2906,6 +4336,10 @@ static test_t rsa_tests[] = {
 		func: test048,
 		disabled: DISABLE_USHORT | DISABLE_UINT | DISABLE_ULLONG,
 	},
+	{
+		description: "number_add() and number_sub() - random operands",
+		func: test049,
+	},
 	/* number devision */
 	{
 		description: "number_dev() - basic functionality",
@@ -2935,6 +4369,28 @@ static test_t rsa_tests[] = {
 		func: test055,
 		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
 	},
+	{
+		description: "number_dev() - random dividends and divisors",
+		func: test058,
+	},
+	{
+		description: "number_dev() - algorithm D vs. bit serial "
+			"benchmark (all levels)",
+		func: test059,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
+	{
+		description: "number_dev_small() and number_mul_small_add() - "
+			"single limb quotients",
+		func: test060,
+	},
+	{
+		description: "number_mod_small() and number_mod_small_many()",
+		func: test050,
+	},
 	{
 		description: "number_extended_euclid_gcd()",
 		func: test056,
@@ -2945,6 +4401,22 @@ static test_t rsa_tests[] = {
 		func: test057,
 		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
 	},
+	{
+		description: "number_extended_euclid_gcd() and "
+			"number_modular_multiplicative_inverse() - random "
+			"operands",
+		func: test090,
+	},
+	{
+		description: "number_init_random_coprime() and "
+			"number_modular_multiplicative_inverse() - key "
+			"generation e and d benchmark (all levels)",
+		func: test103,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
 	/* finding most significant bit */
 	{
 		description: "number_find_most_significant_set_bit()",
@@ -2990,6 +4462,20 @@ static test_t rsa_tests[] = {
 		func: test069,
 		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
 	},
+	/* barrett reduction */
+	{
+		description: "number_barrett_reduce()",
+		func: test065,
+	},
+	{
+		description: "number_barrett_reduce() - barrett vs. division "
+			"benchmark (all levels)",
+		func: test070,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
 	/* setting montgomery factor: 2^(2(encryption_level+2)) */
 	{
 		description: "number_montgomery_factor_set()",
@@ -3004,6 +4490,34 @@ static test_t rsa_tests[] = {
 		func: test072,
 		disabled: DISABLE_UCHAR,
 	},
+	{
+		description: "number_montgomery_factor_set() - cached montgomery "
+			"contexts",
+		func: test073,
+	},
+	{
+		description: "number_*_r() - number contexts at different "
+			"levels",
+		func: test074,
+	},
+	{
+		description: "number_*_r() - concurrent vs. serial contexts",
+		func: test122,
+	},
+	{
+		description: "number_ctx_child_init() - key generation "
+			"contexts seeded apart",
+		func: test123,
+	},
+	{
+		description: "number_montgomery_factor_set() - long division vs. "
+			"shift and subtract",
+		func: test075,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
 	/* montgomery modular multiplication */
 	{
 		description: "number_modular_multiplication_montgomery()",
@@ -3015,6 +4529,11 @@ static test_t rsa_tests[] = {
 		func: test077,
 		disabled: DISABLE_UCHAR,
 	},
+	{
+		description: "number_modular_multiplication_montgomery() vs. "
+			"number_modular_multiplication_naive()",
+		func: test078,
+	},
 	/* montgomery modular exponentiation */
 	{
 		description: "number_modular_exponentiation_montgomery()",
@@ -3048,12 +4567,36 @@ static test_t rsa_tests[] = {
 			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
 			DISABLE_ULLONG_256 | DISABLE_ULLONG_512,
 	},
+	{
+		description: "number_modular_exponentiation_montgomery() vs. "
+			"number_modular_exponentiation_naive()",
+		func: test088,
+	},
 	{
 		description: "2^(encryption_level - 1)",
 		func: test087,
 		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
 			DISABLE_TIME_FUNCTIONS,
 	},
+	{
+		description: "number_modular_exponentiation_montgomery_batch_r"
+			"() - batch engines vs. scalar",
+		func: test079,
+	},
+	{
+		description: "number_modular_exponentiation_montgomery_batch_r"
+			"() - batch engines benchmark (all levels)",
+		func: test080,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
+	{
+		description: "number_exponent_schedule_set_r() - replayed vs. "
+			"recoded exponent",
+		func: test089,
+	},
 	/* prime testing */
 	{
 		description: "number_witness() - basic functionality",
@@ -3126,6 +4669,39 @@ static test_t rsa_tests[] = {
 		func: test102,
 		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
 	},
+	{
+		description: "number_is_prime() - strong pseudoprimes and "
+			"carmichael numbers",
+		func: test105,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
+	},
+	{
+		description: "number_is_prime() - composite rejection and "
+			"prime confirmation benchmark (all levels)",
+		func: test111,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
+	{
+		description: "number_is_prime() - baillie-psw against trial "
+			"division and strong pseudoprimes",
+		func: test113,
+	},
+	{
+		description: "number_lucas_r() - strong lucas pseudoprimes",
+		func: test114,
+	},
+	{
+		description: "number_is_prime() - miller-rabin vs. baillie-psw "
+			"benchmark (all levels)",
+		func: test115,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
 	/* RSA key generation, encryption and decryption */
 	{
 		description: "co prime testing",
@@ -3137,6 +4713,36 @@ static test_t rsa_tests[] = {
 		func: test107,
 		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
 	},
+	{
+		description: "number_find_prime_parallel_r() - same prime as "
+			"number_find_prime_r()",
+		func: test119,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
+	},
+	{
+		description: "number_find_prime_parallel_r() - concurrent "
+			"searches find the serial primes",
+		func: test124,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT,
+	},
+	{
+		description: "number_find_prime_parallel() - threads benchmark "
+			"(all levels)",
+		func: test121,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
+	{
+		description: "number_find_prime() - sieved vs. miller-rabin "
+			"only benchmark (all levels)",
+		func: test104,
+		disabled: DISABLE_UCHAR | DISABLE_USHORT | DISABLE_UINT |
+			DISABLE_ULLONG_64 | DISABLE_ULLONG_128 |
+			DISABLE_ULLONG_256 | DISABLE_ULLONG_512 |
+			DISABLE_TIME_FUNCTIONS,
+	},
 	{
 		description: "encryption - decryption with "
 			"length(n=p1xp2)=1024 bits",